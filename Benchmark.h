@@ -0,0 +1,1243 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Simulation.h"
+#include "InitialConditions.h"
+#include "ThreadPool.h"
+
+// Command line benchmarks, run with "--bench [suite] [options] [N...]" instead of opening a window.
+//   --bench step 1000 100000     leapfrog step cost at the given body counts
+//   --bench solvers              direct summation vs Barnes-Hut at N = 10^4, 10^5, 10^6
+//   --bench kernels [N]          pairwise gravity kernel throughput for every supported ISA
+//   --bench threads [N]          thread pool scaling of a step at 1, 2, 4, ... threads (default N = 10^6)
+//   --bench order [N]            force loop time and cache misses before and after a Morton reorder
+//   --bench hermite [N]          energy error vs wall time, Hermite vs leapfrog on a Plummer sphere (default N = 1000)
+//   --bench pm [N]               particle-mesh time breakdown and force error at mesh sizes 32..256 (default N = 10^5)
+//   --bench treepm [N]           TreePM time and force error across split scales, against Barnes-Hut (default N = 10^5)
+//   --bench fmm [N]              FMM time and force error for orders 1..8, against Barnes-Hut (default N = 10^5)
+//   --bench refit [N]            Barnes-Hut steps with the tree rebuilt every step vs refitted (default N = 10^5)
+//   --bench groups [N]           Barnes-Hut walk one body at a time vs leaf-bucket interaction lists (default N = 10^5)
+//   --bench accuracy [N]         Barnes-Hut force error distribution vs wall time, theta vs relative criterion (default N = 10^5)
+//   --bench ewald [N]            Ewald table compute vs cached startup, its error, periodic tree vs direct, energy drift (default N = 20000)
+//   --bench comoving             Zel'dovich pancake error vs log(a) step, comoving vs static step cost
+//   --bench sph [N...]           SPH cell list check, then neighbour search, density, force and step time (default N = 10^5, 10^6)
+// Options:
+//   --steps k                    number of timed steps per body count (step)
+//   --solver direct|tree|pm|treepm|fmm  force solver used by the step suite
+//   --theta t                    Barnes-Hut opening angle (also the TreePM tree and the FMM acceptance ratio)
+//   --threads n                  thread pool size, 0 = one per hardware thread (default)
+//   --pin                        pin pool workers to cores
+//   --reorder k                  Morton reorder interval in steps, 0 = never (step, threads)
+//   --integrator leapfrog|hermite  integrator used by the step suite
+//   --block                      hierarchical block timesteps (step)
+//   --max-level L                finest block step is dt / 2^L (default 8)
+//   --grid n                     particle-mesh cells per side, a power of two (default 128, TreePM 64)
+//   --split s                    TreePM split scale rs in mesh cells (default 1.25)
+//   --order p                    FMM expansion order, 1..8 (default 4)
+//   --refit [g]                  refit the tree between rebuilds, rebuild when node volume grows g times (default 1.5)
+//   --group g                    Barnes-Hut bucket size for the group walk, 0 = one body at a time (default 32)
+//   --tolerance a                Barnes-Hut relative opening criterion, error below a |a_old|; 0 = theta (default)
+//   --samples n                  targets checked against direct summation (accuracy, default 1000)
+// ------------------------------------------------------------------------
+
+struct BenchOptions
+{
+    std::vector<size_t> counts;
+    int steps = 3;
+    ForceSolver solver = ForceSolver::Direct;
+    float theta = 0.5f;
+    unsigned int threads = 0;
+    bool pin = false;
+    unsigned int reorderInterval = 32;
+    bool blockTimesteps = false;
+    int maxLevel = 8;
+    Integrator integrator = Integrator::Leapfrog;
+    int gridSize = 0;       // 0 = the solver's default
+    float splitCells = 1.25f;
+    int order = 4;
+    float refitGrowth = 0.0f; // 0 = rebuild every step
+    unsigned int groupSize = 32;
+    float errorTolerance = 0.0f;
+    size_t samples = 1000;
+};
+
+inline double benchSeconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void benchStepCost(size_t count, const BenchOptions& options)
+{
+    Simulation sim;
+    sim.solver = options.solver;
+    sim.tree.theta = options.theta;
+    sim.reorderInterval = options.reorderInterval;
+    sim.blockTimesteps = options.blockTimesteps;
+    sim.maxLevel = options.maxLevel;
+    sim.integrator = options.integrator;
+    sim.treePM.tree.theta = options.theta;
+    sim.treePM.splitCells = options.splitCells;
+    sim.fmm.theta = options.theta;
+    sim.fmm.order = options.order;
+    sim.tree.refit = sim.treePM.tree.refit = options.refitGrowth > 0.0f;
+    sim.tree.refitGrowth = sim.treePM.tree.refitGrowth = options.refitGrowth;
+    sim.tree.groupSize = options.groupSize;
+    sim.tree.errorTolerance = options.errorTolerance;
+    if (options.gridSize > 0)
+    {
+        sim.mesh.gridSize = options.gridSize;
+        sim.treePM.mesh.gridSize = options.gridSize;
+    }
+    createDiskGalaxy(sim, count);
+
+    // the first step also evaluates the initial forces, keep it out of the timing
+    sim.step();
+
+    double active = 0.0, work = 0.0, evaluations = 0.0;
+    auto start = std::chrono::steady_clock::now();
+    for (int s = 0; s < options.steps; s++)
+    {
+        sim.step();
+        active += sim.activeFraction;
+        work += sim.workFraction;
+        evaluations += sim.evaluationsPerBody;
+    }
+    double perStep = benchSeconds(start) / options.steps;
+
+    std::cout << std::setw(10) << count
+        << std::setw(14) << std::fixed << std::setprecision(3) << perStep * 1000.0 << " ms/step"
+        << std::setw(14) << std::scientific << std::setprecision(3) << count / perStep << " bodies/s";
+    if (options.blockTimesteps)
+        std::cout << std::fixed << "   active fraction " << active / options.steps << "  work fraction " << work / options.steps
+            << "  evaluations/body " << evaluations / options.steps;
+    std::cout << std::defaultfloat << std::endl;
+}
+
+// Force validation: relative errors |a - a_direct| / |a_direct| on a set of
+// sampled targets, against reference forces summed directly in double.
+// Every force suite below measures its error this way, on the same seed.
+// ------------------------------------------------------------------------
+struct ForceErrorSample
+{
+    std::vector<size_t> targets;
+    std::vector<glm::dvec3> exact;
+
+    ForceErrorSample(const ParticleStore& p, size_t count, float softening, unsigned int seed = 7)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<size_t> pick(0, p.size() - 1);
+        targets.resize(std::min(count, p.size()));
+        for (size_t& t : targets)
+            t = pick(rng);
+        exact.resize(targets.size());
+        const double eps2 = (double)softening * softening;
+        parallelFor(0, targets.size(), [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                const size_t i = targets[k];
+                glm::dvec3 a(0.0);
+                for (size_t j = 0; j < p.size(); j++)
+                {
+                    glm::dvec3 d(p.x[j] - (double)p.x[i], p.y[j] - (double)p.y[i], p.z[j] - (double)p.z[i]);
+                    double r2 = glm::dot(d, d) + eps2;
+                    if (j != i)
+                        a += d * (p.mass[j] / (r2 * std::sqrt(r2)));
+                }
+                exact[k] = a;
+            }
+        }, 4);
+    }
+};
+
+struct ForceErrorStats
+{
+    double median = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0, rms = 0.0;
+};
+
+// accelerations are read from p.ax/ay/az, in the units of the reference (no G)
+inline ForceErrorStats forceErrors(const ParticleStore& p, const ForceErrorSample& sample)
+{
+    ForceErrorStats stats;
+    std::vector<double> errors(sample.targets.size());
+    if (errors.empty())
+        return stats;
+    for (size_t k = 0; k < errors.size(); k++)
+    {
+        glm::dvec3 a(p.acceleration(sample.targets[k]));
+        errors[k] = glm::length(a - sample.exact[k]) / std::max(glm::length(sample.exact[k]), 1e-300);
+        stats.rms += errors[k] * errors[k];
+    }
+    std::sort(errors.begin(), errors.end());
+    auto quantile = [&](double q) { return errors[std::min(errors.size() - 1, (size_t)(q * errors.size()))]; };
+    stats.median = quantile(0.5);
+    stats.p90 = quantile(0.9);
+    stats.p99 = quantile(0.99);
+    stats.max = errors.back();
+    stats.rms = std::sqrt(stats.rms / errors.size());
+    return stats;
+}
+
+// Full Barnes-Hut force evaluation (build and group walk) against direct
+// summation, both as the simulation runs them. Direct summation goes through
+// the SIMD kernel on all targets up to about 10^10 pairs; past that it is
+// timed on an evenly spaced subset of targets and scaled to N (marked *).
+// 1000 random targets, summed in double precision, give the tree's error.
+inline void benchSolvers(size_t count, const BenchOptions& options)
+{
+    Simulation sim;
+    createDiskGalaxy(sim, count);
+
+    Octree tree;
+    tree.theta = options.theta;
+
+    auto start = std::chrono::steady_clock::now();
+    tree.accelerations(sim.particles, sim.softening);
+    double treeTime = benchSeconds(start);
+    double buildTime = tree.buildSeconds;
+
+    const ForceErrorStats errors = forceErrors(sim.particles, ForceErrorSample(sim.particles, 1000, sim.softening));
+
+    // overwrites the tree's accelerations, which are done with by now
+    const size_t direct = std::min(count, std::max<size_t>(1000, (size_t)(1e10 / (double)count)));
+    double directTime;
+    if (direct == count)
+    {
+        start = std::chrono::steady_clock::now();
+        directAccelerations(sim.particles, sim.softening);
+        directTime = benchSeconds(start);
+    }
+    else
+    {
+        std::vector<uint32_t> subset(direct);
+        for (size_t k = 0; k < direct; k++)
+            subset[k] = (uint32_t)(k * count / direct);
+        start = std::chrono::steady_clock::now();
+        directAccelerations(sim.particles, sim.softening, subset);
+        directTime = benchSeconds(start) * (double)count / direct;
+    }
+
+    std::cout << std::setw(10) << count << std::fixed << std::setprecision(1)
+        << std::setw(12) << directTime * 1000.0 << " ms direct" << (direct < count ? "*" : " ")
+        << std::setw(10) << treeTime * 1000.0 << " ms tree"
+        << " (build " << buildTime * 1000.0 << ")"
+        << std::setw(8) << directTime / treeTime << "x"
+        << std::scientific << std::setprecision(2)
+        << "   rms err " << errors.rms << "  max err " << errors.max
+        << std::defaultfloat << std::endl;
+}
+
+// Interactions per second of each SIMD path the CPU supports, on N targets
+// against the same N sources, plus the worst relative error against a
+// double precision sum.
+inline void benchKernels(size_t count)
+{
+    Simulation sim;
+    createDiskGalaxy(sim, count);
+    const ParticleStore& p = sim.particles;
+    const float eps2 = sim.softening * sim.softening;
+    const GravitySources sources = { p.x.data(), p.y.data(), p.z.data(), p.mass.data(), p.size() };
+
+    const SimdIsa native = nativeSimdIsa();
+    std::cout << "Pairwise gravity kernels, " << count << " x " << count
+        << " interactions, native ISA " << simdIsaName(native) << std::endl;
+
+    const SimdIsa paths[] = { SimdIsa::Scalar, SimdIsa::SSE42, SimdIsa::AVX2, SimdIsa::AVX512 };
+    for (SimdIsa isa : paths)
+    {
+        if ((int)isa > (int)native)
+            break;
+        GravityKernelFn kernel = gravityKernelFor(isa);
+
+        double worst = 0.0;
+        for (size_t i = 0; i < count; i += std::max<size_t>(1, count / 64))
+        {
+            float acc[3];
+            kernel(sources, p.x[i], p.y[i], p.z[i], eps2, acc);
+            glm::vec3 exact = directAcceleration(p, i, sim.softening);
+            worst = std::max(worst, (double)(glm::length(glm::vec3(acc[0], acc[1], acc[2]) - exact) / glm::length(exact)));
+        }
+
+        // repeat the full N x N sweep until the timing is long enough to trust
+        float sink = 0.0f;
+        int sweeps = 0;
+        auto start = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+        do
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                float acc[3];
+                kernel(sources, p.x[i], p.y[i], p.z[i], eps2, acc);
+                sink += acc[0];
+            }
+            sweeps++;
+            elapsed = benchSeconds(start);
+        } while (elapsed < 0.5);
+
+        double rate = (double)count * count * sweeps / elapsed;
+        std::cout << std::setw(10) << simdIsaName(isa)
+            << std::setw(14) << std::scientific << std::setprecision(3) << rate << " interactions/s"
+            << "   max rel err " << std::setprecision(2) << worst
+            << (sink == 12345.0f ? " " : "") << std::defaultfloat << std::endl;
+    }
+}
+
+// Step cost with the pool at 1, 2, 4, ... threads up to the hardware thread
+// count. The threads suite defaults to Barnes-Hut since a direct 10^6 step
+// would take hours; pass "--solver direct" with a smaller N to compare.
+inline void benchThreads(size_t count, const BenchOptions& options, ForceSolver solver)
+{
+    const unsigned int hardware = ThreadPool::defaultThreadCount();
+    std::vector<unsigned int> threadCounts;
+    for (unsigned int t = 1; t < hardware; t *= 2)
+        threadCounts.push_back(t);
+    threadCounts.push_back(hardware);
+
+    std::cout << "Thread scaling, " << count << " bodies, "
+        << forceSolverName(solver)
+        << ", " << options.steps << " steps, " << hardware << " hardware threads"
+        << (options.pin ? ", pinned" : "") << std::endl;
+
+    Simulation initial;
+    createDiskGalaxy(initial, count);
+
+    double baseline = 0.0;
+    for (unsigned int threads : threadCounts)
+    {
+        configureThreadPool(threads, options.pin);
+        Simulation sim = initial;
+        sim.solver = solver;
+        sim.tree.theta = options.theta;
+        sim.reorderInterval = options.reorderInterval;
+        sim.step();
+
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < options.steps; s++)
+            sim.step();
+        double perStep = benchSeconds(start) / options.steps;
+        if (threads == 1)
+            baseline = perStep;
+
+        std::cout << std::setw(6) << threads << " threads"
+            << std::fixed << std::setprecision(1) << std::setw(12) << perStep * 1000.0 << " ms/step"
+            << std::setprecision(2) << std::setw(9) << baseline / perStep << "x speedup"
+            << std::setw(8) << std::setprecision(0) << 100.0 * baseline / perStep / threads << "% efficiency"
+            << std::defaultfloat << std::endl;
+    }
+    configureThreadPool(options.threads, options.pin);
+}
+
+// Hardware cache miss counter for the calling thread. Uses perf_event_open on
+// Linux; elsewhere, or when the kernel refuses (containers, perf_event_paranoid),
+// available() is false and the benchmark prints n/a.
+class CacheMissCounter
+{
+public:
+    enum Event
+    {
+        L1DReadMisses,   // first level data cache read misses
+        LastLevelMisses  // generic "cache misses", the last level cache on most CPUs
+    };
+
+    explicit CacheMissCounter(Event event)
+    {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        if (event == L1DReadMisses)
+        {
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        }
+        else
+        {
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        }
+        fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+        (void)event;
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    CacheMissCounter(const CacheMissCounter&) = delete;
+    CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+    bool available() const
+    {
+        return fd >= 0;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    long long stop()
+    {
+        long long count = -1;
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &count, sizeof(count)) != sizeof(count))
+                count = -1;
+        }
+#endif
+        return count;
+    }
+
+private:
+    int fd = -1;
+};
+
+// One Barnes-Hut force evaluation (build + walk) and one direct summation
+// sweep over a sample of targets, first in the order the initial conditions
+// produce (random along the disk) and then after a Morton reorder. Runs on a
+// one-thread pool so the per-thread miss counters see the whole loop.
+inline void benchOrder(size_t count, const BenchOptions& options)
+{
+    configureThreadPool(1);
+
+    Simulation sim;
+    createDiskGalaxy(sim, count);
+    sim.tree.theta = options.theta;
+
+    CacheMissCounter l1(CacheMissCounter::L1DReadMisses);
+    CacheMissCounter llc(CacheMissCounter::LastLevelMisses);
+    std::cout << "Force loop before and after Morton reordering, " << count << " bodies, one thread" << std::endl;
+    if (!l1.available() || !llc.available())
+        std::cout << "(hardware counters unavailable here, cache misses show as n/a)" << std::endl;
+
+    auto missText = [](long long misses)
+    {
+        return misses < 0 ? std::string("n/a") : std::to_string(misses);
+    };
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        double reorderTime = 0.0;
+        if (pass == 1)
+        {
+            auto start = std::chrono::steady_clock::now();
+            mortonReorder(sim.particles);
+            reorderTime = benchSeconds(start);
+        }
+
+        sim.tree.build(sim.particles); // warm up allocations
+        l1.start();
+        llc.start();
+        auto start = std::chrono::steady_clock::now();
+        sim.tree.build(sim.particles);
+        double buildTime = benchSeconds(start);
+        for (unsigned int i : sim.tree.index)
+            sim.particles.setAcceleration(i, sim.tree.acceleration(sim.particles.position(i), i, sim.particles, sim.softening));
+        double treeTime = benchSeconds(start);
+        long long l1Misses = l1.stop();
+        long long llcMisses = llc.stop();
+
+        // direct summation streams the columns in order either way, so time
+        // it over a strided sample of targets only as a control
+        const size_t stride = std::max<size_t>(1, count / 1000);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; i += stride)
+            sim.particles.setAcceleration(i, directAcceleration(sim.particles, i, sim.softening));
+        double directTime = benchSeconds(start);
+
+        std::cout << std::setw(8) << (pass == 0 ? "random" : "morton") << std::fixed << std::setprecision(1)
+            << std::setw(10) << treeTime * 1000.0 << " ms tree (build " << buildTime * 1000.0 << ")"
+            << std::setw(10) << directTime * 1000.0 << " ms direct sample"
+            << "   L1D misses " << std::setw(12) << missText(l1Misses)
+            << "   LLC misses " << std::setw(12) << missText(llcMisses);
+        if (pass == 1)
+            std::cout << "   (reorder " << std::setprecision(1) << reorderTime * 1000.0 << " ms)";
+        std::cout << std::defaultfloat << std::endl;
+    }
+
+    configureThreadPool(options.threads, options.pin);
+}
+
+// Worst relative energy error over one time unit on a Plummer sphere in
+// N-body units, for a ladder of timesteps, so the two integrators can be
+// compared at equal wall time rather than equal dt. The error is checked at
+// 16 points outside the timed region: leapfrog's error oscillates, so the end
+// point alone would flatter it.
+inline void benchHermite(size_t count)
+{
+    const float softening = 0.01f;
+    const double duration = 1.0;
+    std::cout << "Plummer sphere, " << count << " bodies, softening " << softening
+        << ", direct summation, integrated to t = " << duration << std::endl;
+    std::cout << std::setw(10) << "integrator" << std::setw(12) << "dt" << std::setw(8) << "steps"
+        << std::setw(14) << "wall ms" << std::setw(14) << "max |dE/E|" << std::endl;
+
+    const Integrator integrators[] = { Integrator::Leapfrog, Integrator::Hermite };
+    for (Integrator integrator : integrators)
+    {
+        for (int steps = 64; steps <= 1024; steps *= 2)
+        {
+            Simulation sim((float)(duration / steps), softening);
+            sim.integrator = integrator;
+            sim.reorderInterval = 0;
+            createPlummerSphere(sim, count);
+            const double e0 = sim.kineticEnergy() + sim.potentialEnergy();
+
+            double wall = 0.0, worst = 0.0;
+            for (int checkpoint = 0; checkpoint < 16; checkpoint++)
+            {
+                auto start = std::chrono::steady_clock::now();
+                for (int s = 0; s < steps / 16; s++)
+                    sim.step();
+                wall += benchSeconds(start);
+                double e = sim.kineticEnergy() + sim.potentialEnergy();
+                worst = std::max(worst, std::abs((e - e0) / e0));
+            }
+
+            std::cout << std::setw(10) << (integrator == Integrator::Hermite ? "hermite" : "leapfrog")
+                << std::setw(12) << std::setprecision(4) << sim.timeStep << std::setw(8) << steps
+                << std::setw(14) << std::fixed << std::setprecision(1) << wall * 1000.0
+                << std::setw(14) << std::scientific << std::setprecision(2) << worst
+                << std::defaultfloat << std::endl;
+        }
+    }
+}
+
+// Particle-mesh force evaluation at several mesh sizes with CIC and TSC
+// assignment: time per phase and the force error against direct summation
+// on 1000 sampled targets. The first evaluation at each size builds the
+// Green's function and is not timed. PM smooths everything below a few
+// cells, so the error shrinks with the mesh until the softening dominates.
+inline void benchParticleMesh(size_t count)
+{
+    Simulation sim;
+    createDiskGalaxy(sim, count);
+    ParticleStore& p = sim.particles;
+    const ForceErrorSample sample(p, 1000, sim.softening);
+
+    std::cout << "Particle-mesh force evaluation, " << count << " bodies, isolated boundaries, "
+        << threadPool().size() << " threads" << std::endl;
+    std::cout << std::setw(6) << "mesh" << std::setw(6) << "kern" << std::setw(10) << "cell"
+        << std::setw(11) << "deposit" << std::setw(11) << "fft" << std::setw(11) << "gradient"
+        << std::setw(11) << "interp" << std::setw(11) << "total" << std::setw(12) << "rms err"
+        << std::setw(12) << "median err" << std::endl;
+
+    const int sizes[] = { 32, 64, 128, 256 };
+    for (int n : sizes)
+    {
+        for (MassAssignment scheme : { MassAssignment::CIC, MassAssignment::TSC })
+        {
+            ParticleMesh mesh;
+            mesh.gridSize = n;
+            mesh.assignment = scheme;
+            mesh.accelerations(p, sim.softening);
+
+            auto start = std::chrono::steady_clock::now();
+            mesh.accelerations(p, sim.softening);
+            double total = benchSeconds(start);
+            const ForceErrorStats errors = forceErrors(p, sample);
+
+            const ParticleMesh::Timings& t = mesh.timings;
+            std::cout << std::setw(6) << n << std::setw(6) << (scheme == MassAssignment::CIC ? "CIC" : "TSC")
+                << std::setw(10) << std::setprecision(3) << mesh.cellSize()
+                << std::fixed << std::setprecision(1)
+                << std::setw(8) << t.deposit * 1000.0 << " ms" << std::setw(8) << t.fft * 1000.0 << " ms"
+                << std::setw(8) << t.gradient * 1000.0 << " ms" << std::setw(8) << t.interpolate * 1000.0 << " ms"
+                << std::setw(8) << total * 1000.0 << " ms"
+                << std::scientific << std::setprecision(2)
+                << std::setw(12) << errors.rms << std::setw(12) << errors.median
+                << std::defaultfloat << std::endl;
+        }
+    }
+}
+
+// TreePM force evaluation across split scales against a plain Barnes-Hut
+// walk at the same theta, with the force error on 1000 sampled targets
+// against direct summation. The mesh size stays fixed (--grid, default 64),
+// so a larger split means a longer cutoff and more tree work. Runs on the
+// disk, where nearly every cell lies inside the cutoff, and on a uniform
+// cube (the periodic box IC solved as an isolated one), where most don't.
+inline void benchTreePM(const std::string& name, Simulation& sim, const BenchOptions& options)
+{
+    ParticleStore& p = sim.particles;
+    const size_t count = p.size();
+    const ForceErrorSample sample(p, 1000, sim.softening);
+
+    auto report = [&](const std::string& label, double total, const std::string& extra)
+    {
+        const ForceErrorStats errors = forceErrors(p, sample);
+        std::cout << std::setw(18) << label << std::fixed << std::setprecision(1)
+            << std::setw(10) << total * 1000.0 << " ms" << std::scientific << std::setprecision(2)
+            << "   rms err " << errors.rms << "  median err " << errors.median
+            << std::defaultfloat << extra << std::endl;
+    };
+
+    const int grid = options.gridSize > 0 ? options.gridSize : 64;
+    std::cout << "TreePM force evaluation, " << name << ", " << count << " bodies, " << grid << "^3 mesh, theta "
+        << options.theta << ", " << threadPool().size() << " threads" << std::endl;
+
+    Octree tree;
+    tree.theta = options.theta;
+    auto start = std::chrono::steady_clock::now();
+    tree.accelerations(p, sim.softening);
+    report("Barnes-Hut", benchSeconds(start), "");
+
+    const float splits[] = { 0.75f, 1.0f, 1.25f, 1.5f, 2.0f, 3.0f };
+    for (float split : splits)
+    {
+        TreePM treePM;
+        treePM.tree.theta = options.theta;
+        treePM.mesh.gridSize = grid;
+        treePM.splitCells = split;
+        treePM.accelerations(p, sim.softening); // builds the Green's function
+
+        start = std::chrono::steady_clock::now();
+        treePM.accelerations(p, sim.softening);
+        double total = benchSeconds(start);
+
+        std::ostringstream extra;
+        extra << std::fixed << std::setprecision(1) << "   (mesh " << treePM.meshSeconds * 1000.0
+            << " ms, tree " << treePM.treeSeconds * 1000.0 << " ms, rs " << std::setprecision(2)
+            << treePM.mesh.splitRadius() << ")";
+        std::ostringstream label;
+        label << "TreePM split " << std::fixed << std::setprecision(2) << split;
+        report(label.str(), total, extra.str());
+    }
+}
+
+inline void benchTreePM(size_t count, const BenchOptions& options)
+{
+    Simulation disk, cube;
+    createDiskGalaxy(disk, count);
+    createPeriodicBox(cube, count);
+    benchTreePM("disk", disk, options);
+    benchTreePM("uniform cube", cube, options);
+}
+
+// FMM at expansion orders 1..8 (acceptance ratio from --theta) next to
+// Barnes-Hut at a few opening angles: wall time against the force error on
+// 1000 sampled targets, so the two accuracy/time curves can be compared.
+inline void benchFMM(size_t count, const BenchOptions& options)
+{
+    Simulation sim;
+    createDiskGalaxy(sim, count);
+    ParticleStore& p = sim.particles;
+    const ForceErrorSample sample(p, 1000, sim.softening);
+
+    std::cout << "FMM vs Barnes-Hut, " << count << " bodies, " << threadPool().size() << " threads" << std::endl;
+    const float angles[] = { 0.3f, 0.5f, 0.7f, 0.9f };
+    for (float angle : angles)
+    {
+        Octree tree;
+        tree.theta = angle;
+        auto start = std::chrono::steady_clock::now();
+        tree.accelerations(p, sim.softening);
+        double total = benchSeconds(start);
+        std::cout << "  Barnes-Hut theta " << std::fixed << std::setprecision(1) << angle
+            << std::setw(10) << total * 1000.0 << " ms" << std::scientific << std::setprecision(2)
+            << "   rms err " << forceErrors(p, sample).rms << std::defaultfloat << std::endl;
+    }
+
+    for (int order = 1; order <= 8; order++)
+    {
+        FastMultipole fmm;
+        fmm.order = order;
+        fmm.theta = options.theta;
+        auto start = std::chrono::steady_clock::now();
+        fmm.accelerations(p, sim.softening);
+        double total = benchSeconds(start);
+        const FastMultipole::Timings& t = fmm.timings;
+        std::cout << "  FMM p " << order << ", theta " << std::fixed << std::setprecision(1) << fmm.theta
+            << std::setw(10) << total * 1000.0 << " ms" << std::scientific << std::setprecision(2)
+            << "   rms err " << forceErrors(p, sample).rms << std::fixed << std::setprecision(1)
+            << "   (build " << t.build * 1000.0 << ", up " << t.upward * 1000.0 << ", walk " << t.walk * 1000.0
+            << ", M2L " << t.m2l * 1000.0 << ", down " << t.downward * 1000.0 << " ms; "
+            << fmm.cellInteractions << " M2L, " << fmm.leafInteractions << " leaf pairs)"
+            << std::defaultfloat << std::endl;
+    }
+}
+
+// Barnes-Hut leapfrog steps with the tree rebuilt every step, then refitted
+// between rebuilds (--refit g sets the growth threshold, default 1.5). Both
+// runs start from the same state; reports tree time per step, how often
+// each path ran, and the force error of the final tree against direct
+// summation on 1000 sampled targets.
+inline void benchRefit(size_t count, const BenchOptions& options)
+{
+    const int steps = std::max(options.steps, 20);
+    const float growthLimit = options.refitGrowth > 0.0f ? options.refitGrowth : 1.5f;
+    Simulation initial;
+    initial.solver = ForceSolver::BarnesHut;
+    initial.tree.theta = options.theta;
+    initial.reorderInterval = options.reorderInterval;
+    createDiskGalaxy(initial, count);
+
+    std::cout << "Tree rebuild vs refit, " << count << " bodies, " << steps << " steps, theta " << options.theta
+        << ", rebuild at growth " << growthLimit << ", " << threadPool().size() << " threads" << std::endl;
+
+    for (int refit = 0; refit < 2; refit++)
+    {
+        Simulation sim = initial;
+        sim.tree.refit = refit == 1;
+        sim.tree.refitGrowth = growthLimit;
+        sim.step();
+        const Octree before = sim.tree;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; s++)
+            sim.step();
+        double perStep = benchSeconds(start) / steps;
+        const Octree& tree = sim.tree;
+        double treeTime = (tree.buildSeconds - before.buildSeconds) + (tree.refitSeconds - before.refitSeconds);
+
+        // the tree as it stands (refitted once more, or rebuilt) against direct summation
+        ParticleStore& p = sim.particles;
+        sim.tree.accelerations(p, sim.softening);
+        const ForceErrorStats errors = forceErrors(p, ForceErrorSample(p, 1000, sim.softening));
+
+        std::cout << (refit ? "  refit  " : "  rebuild") << std::fixed << std::setprecision(2)
+            << std::setw(10) << perStep * 1000.0 << " ms/step"
+            << std::setw(10) << treeTime / steps * 1000.0 << " ms tree/step"
+            << "   rebuilds " << tree.rebuilds - before.rebuilds << ", refits " << tree.refits - before.refits
+            << ", growth " << tree.growth
+            << std::scientific << "   rms err " << errors.rms
+            << std::defaultfloat << std::endl;
+    }
+}
+
+// The Barnes-Hut walk on one tree, one body at a time and then in buckets of
+// 16, 32 and 64 bodies sharing an interaction list. Bucket lists are built
+// against the bucket's box, so they open more cells than a single body would
+// and carry more interactions; the SIMD evaluation is what pays for that.
+// Force error against direct summation on 1000 sampled targets.
+inline void benchGroups(size_t count, const BenchOptions& options)
+{
+    Simulation sim;
+    createDiskGalaxy(sim, count);
+    mortonReorder(sim.particles);
+    ParticleStore& p = sim.particles;
+    const ForceErrorSample sample(p, 1000, sim.softening);
+
+    Octree tree;
+    tree.theta = options.theta;
+    tree.build(p);
+    std::cout << "Barnes-Hut walk, " << count << " bodies, theta " << options.theta << ", "
+        << threadPool().size() << " threads, " << simdIsaName(nativeSimdIsa()) << std::endl;
+
+    const unsigned int sizes[] = { 0, 16, 32, 64 };
+    for (unsigned int groupSize : sizes)
+    {
+        tree.groupSize = groupSize;
+        tree.accelerations(p, sim.softening); // warm up
+        double best = 1e30;
+        for (int r = 0; r < std::max(options.steps, 1); r++)
+        {
+            tree.accelerations(p, sim.softening);
+            best = std::min(best, tree.walkSeconds);
+        }
+
+        std::cout << (groupSize == 0 ? "  per body  " : "  bucket " + std::to_string(groupSize) + (groupSize < 100 ? " " : ""))
+            << std::fixed << std::setprecision(2) << std::setw(10) << best * 1000.0 << " ms";
+        if (groupSize > 0)
+            std::cout << std::scientific << "   " << tree.interactions / best << " interactions/s"
+                << std::fixed << std::setprecision(1) << "   list " << tree.meanListLength;
+        std::cout << std::scientific << std::setprecision(2) << "   rms err " << forceErrors(p, sample).rms
+            << std::defaultfloat << std::endl;
+    }
+}
+
+// Barnes-Hut force error distribution against the time of one evaluation
+// (build + walk), for a ladder of opening angles and of relative tolerances.
+// The relative criterion needs last step's accelerations: every relative run
+// starts from those of a theta 0.5 evaluation, which is what the first step
+// of a simulation leaves behind.
+inline void benchAccuracy(size_t count, const BenchOptions& options)
+{
+    Simulation sim;
+    createDiskGalaxy(sim, count);
+    mortonReorder(sim.particles);
+    ParticleStore& p = sim.particles;
+
+    auto start = std::chrono::steady_clock::now();
+    ForceErrorSample sample(p, options.samples, sim.softening);
+    std::cout << "Barnes-Hut force error vs time, " << count << " bodies, group " << options.groupSize << ", "
+        << threadPool().size() << " threads; " << sample.targets.size() << " direct-sum references in "
+        << std::fixed << std::setprecision(2) << benchSeconds(start) << " s" << std::defaultfloat << std::endl;
+    std::cout << "                      ms    median       90%       99%       max       rms" << std::endl;
+
+    Octree tree;
+    tree.groupSize = options.groupSize;
+    tree.accelerations(p, sim.softening);
+    const ParticleStore previous = p;
+
+    auto run = [&](float theta, float tolerance)
+    {
+        tree.theta = theta;
+        tree.errorTolerance = tolerance;
+        p.ax = previous.ax;
+        p.ay = previous.ay;
+        p.az = previous.az;
+        auto begin = std::chrono::steady_clock::now();
+        tree.accelerations(p, sim.softening);
+        double seconds = benchSeconds(begin);
+        ForceErrorStats e = forceErrors(p, sample);
+
+        std::ostringstream label;
+        if (tolerance > 0.0f)
+            label << "relative " << tolerance;
+        else
+            label << "theta " << theta;
+        std::cout << "  " << std::left << std::setw(16) << label.str() << std::right
+            << std::fixed << std::setprecision(1) << std::setw(8) << seconds * 1000.0
+            << std::scientific << std::setprecision(2)
+            << std::setw(10) << e.median << std::setw(10) << e.p90 << std::setw(10) << e.p99
+            << std::setw(10) << e.max << std::setw(10) << e.rms << std::defaultfloat << std::endl;
+    };
+
+    for (float theta : { 0.3f, 0.5f, 0.7f, 0.9f })
+        run(theta, 0.0f);
+    std::vector<float> tolerances = { 0.0005f, 0.001f, 0.0025f, 0.005f, 0.01f };
+    if (options.errorTolerance > 0.0f)
+        tolerances = { options.errorTolerance };
+    for (float tolerance : tolerances)
+        run(options.theta, tolerance);
+}
+
+// Ewald periodic gravity: the cost of computing the correction table
+// against mapping the cached copy, the interpolation error against the
+// exact Ewald sum at random separations (relative to the full periodic
+// acceleration), and periodic Barnes-Hut against periodic direct summation
+// on a uniform box, sampled on 500 targets.
+inline void benchEwald(size_t count)
+{
+    const std::string path = ewaldCachePath().empty() ? std::string("ewald_table.bin") : ewaldCachePath();
+    std::cout << "Ewald table, " << EwaldTable::cells << "^3 cells per octant, " << threadPool().size() << " threads" << std::endl;
+
+    EwaldTable computed;
+    auto start = std::chrono::steady_clock::now();
+    computed.compute();
+    std::cout << "  compute   " << std::fixed << std::setprecision(3) << benchSeconds(start) << " s" << std::endl;
+    bool saved = computed.save(path);
+
+    EwaldTable mapped;
+    mapped.open(path);
+    std::cout << "  startup   " << std::setprecision(3) << mapped.seconds * 1000.0 << " ms "
+        << (mapped.fromCache ? "mapping " + path : std::string("(cache not writable, recomputed)"))
+        << (saved ? "" : ", save failed") << std::defaultfloat << std::endl;
+
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> uniform(-0.5, 0.5);
+    double worst = 0.0, rms = 0.0;
+    const int points = 20000;
+    for (int k = 0; k < points; k++)
+    {
+        glm::dvec3 d(uniform(rng), uniform(rng), uniform(rng));
+        double r = glm::length(d);
+        if (r < 0.02)
+            continue;
+        glm::dvec4 e = EwaldTable::exact(glm::abs(d));
+        glm::dvec3 t = glm::dvec3(d.x < 0 ? -e.x : e.x, d.y < 0 ? -e.y : e.y, d.z < 0 ? -e.z : e.z);
+        glm::dvec3 full = d / (r * r * r) + t;
+        double err = glm::length(glm::dvec3(mapped.acceleration(glm::vec3(d), 1.0f)) - t) / glm::length(full);
+        worst = std::max(worst, err);
+        rms += err * err;
+    }
+    std::cout << "  table error vs exact sum: rms " << std::scientific << std::setprecision(2) << std::sqrt(rms / points)
+        << ", max " << worst << std::defaultfloat << std::endl;
+
+    Simulation sim;
+    createPeriodicBox(sim, count);
+    ParticleStore& p = sim.particles;
+    const EwaldTable& table = ewaldTable();
+    const size_t samples = std::min<size_t>(p.size(), 500);
+    std::vector<glm::vec3> exact(samples);
+    start = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < samples; k++)
+        exact[k] = periodicDirectAcceleration(p, k * p.size() / samples, sim.softening, sim.boxSize, table);
+    double direct = benchSeconds(start) * p.size() / samples;
+
+    std::cout << "Periodic uniform box, " << count << " bodies, softening " << sim.softening << std::endl;
+    std::cout << "  direct       " << std::fixed << std::setprecision(1) << std::setw(10) << direct * 1000.0 << " ms*" << std::endl;
+    for (float theta : { 0.3f, 0.5f, 0.7f })
+    {
+        Octree tree;
+        tree.theta = theta;
+        tree.boxSize = sim.boxSize;
+        start = std::chrono::steady_clock::now();
+        tree.accelerations(p, sim.softening);
+        double seconds = benchSeconds(start);
+        double err2 = 0.0;
+        for (size_t k = 0; k < samples; k++)
+        {
+            glm::vec3 a = p.acceleration(k * p.size() / samples);
+            double d = glm::length(a - exact[k]) / std::max(glm::length(exact[k]), 1e-30f);
+            err2 += d * d;
+        }
+        std::cout << "  tree theta " << std::setprecision(1) << theta << std::setw(10) << seconds * 1000.0 << " ms "
+            << std::scientific << std::setprecision(2) << "   rms err " << std::sqrt(err2 / samples)
+            << std::fixed << std::endl;
+    }
+    std::cout << std::defaultfloat << "  * extrapolated from " << samples << " sampled targets" << std::endl;
+
+    // energy drift of tree leapfrog steps at the box's own timestep, through
+    // the Poisson clustering; the energy sums the images too
+    Simulation run;
+    const size_t runCount = std::min<size_t>(count, 2000);
+    const int steps = 100;
+    createPeriodicBox(run, runCount);
+    run.solver = ForceSolver::BarnesHut;
+    const double e0 = run.kineticEnergy() + run.potentialEnergy();
+    for (int s = 0; s < steps; s++)
+        run.step();
+    const double e1 = run.kineticEnergy() + run.potentialEnergy();
+    std::cout << "  energy, " << runCount << " bodies, " << steps << " tree steps of dt " << run.timeStep
+        << ": |dE/E| " << std::scientific << std::setprecision(2) << std::abs((e1 - e0) / e0)
+        << std::defaultfloat << std::endl;
+}
+
+// Comoving leapfrog on an 8 x 16 x 16 Zel'dovich pancake from a = 0.1 to 0.5
+// (the planes cross at 1) with periodic direct summation, or --solver tree:
+// rms x error against the exact solution, in units of the displacement at
+// the end, for a ladder of log(a) steps. Then what the expansion costs: the
+// table build, the per-step factor lookups, and a step against the same step
+// with comoving off.
+inline void benchComoving(const BenchOptions& options)
+{
+    const ForceSolver solver = options.solver == ForceSolver::BarnesHut ? ForceSolver::BarnesHut : ForceSolver::Direct;
+    const double aStart = 0.1, aEnd = 0.5, aCross = 1.0;
+    const int nx = 8, ny = 16; // dense sheets, so they act like planes
+    std::cout << "Comoving Zel'dovich pancake, " << nx * ny * ny << " bodies, a " << aStart << " -> " << aEnd
+        << ", " << forceSolverName(solver) << std::endl;
+
+    for (int steps : { 8, 16, 32 })
+    {
+        Simulation sim;
+        sim.solver = solver;
+        createZeldovichPancake(sim, nx, ny, aStart, aCross);
+        sim.timeStep = (float)(std::log(aEnd / aStart) / steps);
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < steps; s++)
+            sim.step();
+        double seconds = benchSeconds(start);
+
+        const ParticleStore& p = sim.particles;
+        const float k = 2.0f * glm::pi<float>() / sim.boxSize;
+        double err2 = 0.0;
+        for (size_t i = 0; i < p.size(); i++)
+        {
+            float q = (p.id[i] % nx + 0.5f) * sim.boxSize / nx;
+            float exact = zeldovichPosition(q, sim.scaleFactor, aCross, sim.boxSize);
+            double d = periodicDelta(p.x[i] - exact, sim.boxSize);
+            err2 += d * d;
+        }
+        double amplitude = sim.scaleFactor / aCross / k;
+        // Einstein-de Sitter: t = 2 / (3 H0) a^(3/2)
+        double exactTime = 2.0 / (3.0 * sim.cosmology.hubble) * (std::pow(aEnd, 1.5) - std::pow(aStart, 1.5));
+        std::cout << "  " << std::setw(3) << steps << " steps, dln(a) " << std::fixed << std::setprecision(4) << sim.timeStep
+            << "   a " << sim.scaleFactor << "   t " << std::setprecision(6) << sim.time << " (exact " << exactTime << ")"
+            << std::scientific << std::setprecision(2)
+            << "   rms x err " << std::sqrt(err2 / p.size()) / amplitude << std::fixed << std::setprecision(1)
+            << "   " << seconds * 1000.0 / steps << " ms/step" << std::defaultfloat << std::endl;
+    }
+
+    CosmologyTables tables;
+    Cosmology lcdm;
+    lcdm.omegaMatter = 0.3;
+    lcdm.omegaLambda = 0.7;
+    auto start = std::chrono::steady_clock::now();
+    tables.build(lcdm, 0.01, 10.0);
+    double build = benchSeconds(start);
+    const int lookups = 1000000;
+    double sink = 0.0, a = 0.02;
+    start = std::chrono::steady_clock::now();
+    for (int s = 0; s < lookups; s++)
+    {
+        double a2 = a * 1.000001, a1 = std::sqrt(a * a2);
+        sink += tables.kick(a, a1) + tables.drift(a, a2) + tables.kick(a1, a2) + tables.time(a, a2);
+        a = a2;
+    }
+    double perStep = benchSeconds(start) / lookups;
+    std::cout << "  tables: built in " << std::fixed << std::setprecision(1) << build * 1e6 << " us, factors for a step in "
+        << perStep * 1e9 << " ns" << (sink == 0.0 ? " " : "") << std::endl;
+
+    for (int mode = 0; mode < 2; mode++)
+    {
+        Simulation sim;
+        sim.solver = solver;
+        createZeldovichPancake(sim, nx, ny, aStart, aCross);
+        sim.comoving = mode == 1;
+        sim.timeStep = mode == 1 ? 0.01f : 1e-4f;
+        sim.step();
+        auto begin = std::chrono::steady_clock::now();
+        for (int s = 0; s < 10; s++)
+            sim.step();
+        std::cout << (mode ? "  comoving step " : "  static step   ") << std::fixed << std::setprecision(2)
+            << benchSeconds(begin) * 100.0 << " ms" << std::defaultfloat << std::endl;
+    }
+}
+
+// SPH on a periodic gas box at Mach 1 with gravity off. First the cell list
+// against a brute force neighbour count on 10^4 bodies, then for each N the
+// time of the cell list build, a bare neighbour search, the density pass
+// (with its smoothing length iterations), the force pass and a whole step,
+// averaged over a few steps at half the Courant limit.
+inline void benchSPH(const std::vector<size_t>& counts)
+{
+    {
+        const size_t n = 10000;
+        Simulation sim;
+        createGasBox(sim, n, 1.0f, 1.0f, 1.0f, 1.0f);
+        sim.gravity = false;
+        sim.step();
+        const ParticleStore& p = sim.particles;
+
+        auto start = std::chrono::steady_clock::now();
+        unsigned long long cells = sim.sph.countNeighbours(p, sim.boxSize);
+        double cellSeconds = benchSeconds(start);
+        start = std::chrono::steady_clock::now();
+        unsigned long long brute = parallelReduce(0, n, 0ull, [&](size_t b, size_t e)
+        {
+            unsigned long long count = 0;
+            for (size_t i = b; i < e; i++)
+            {
+                const float r2Max = 4.0f * p.smoothing[i] * p.smoothing[i];
+                for (size_t j = 0; j < n; j++)
+                {
+                    glm::vec3 d = periodicDelta(p.position(j) - p.position(i), sim.boxSize);
+                    count += glm::dot(d, d) < r2Max;
+                }
+            }
+            return count;
+        }, [](unsigned long long a, unsigned long long b) { return a + b; }, 64);
+        double bruteSeconds = benchSeconds(start);
+        std::cout << "Neighbour check, " << n << " gas bodies: cell list " << cells << " pairs in " << std::fixed
+            << std::setprecision(2) << cellSeconds * 1000.0 << " ms, brute force " << brute << " in "
+            << bruteSeconds * 1000.0 << " ms" << (cells == brute ? "" : "  MISMATCH") << std::defaultfloat << std::endl;
+    }
+
+    std::cout << "SPH gas box, Mach 1, no gravity (times in ms per step)" << std::endl;
+    std::cout << std::setw(9) << "N" << std::setw(7) << "cells" << std::setw(8) << "ngb" << std::setw(7) << "iter"
+        << std::setw(10) << "cell list" << std::setw(10) << "search" << std::setw(10) << "density"
+        << std::setw(10) << "forces" << std::setw(10) << "step" << std::setw(12) << "bodies/s" << std::endl;
+    for (size_t n : counts)
+    {
+        Simulation sim;
+        createGasBox(sim, n, 1.0f, 1.0f, 1.0f, 1.0f);
+        sim.gravity = false;
+        sim.reorderInterval = 0;
+        sim.timeStep = 0.0f;
+        sim.step(); // smoothing lengths from the initial guess
+        sim.timeStep = 0.5f * sim.sph.courantStep;
+
+        const int steps = 3;
+        double build = 0.0, search = 0.0, density = 0.0, forces = 0.0, step = 0.0, neighbours = 0.0, iterations = 0.0;
+        for (int s = 0; s < steps; s++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            sim.step();
+            step += benchSeconds(start);
+            build += sim.sph.buildSeconds;
+            density += sim.sph.densitySeconds;
+            forces += sim.sph.forceSeconds;
+            neighbours += sim.sph.meanNeighbours;
+            iterations += sim.sph.meanIterations;
+
+            start = std::chrono::steady_clock::now();
+            sim.sph.countNeighbours(sim.particles, sim.boxSize);
+            search += benchSeconds(start);
+        }
+        glm::ivec3 dims = sim.sph.dims;
+        std::cout << std::setw(9) << n << std::setw(7) << dims.x << std::fixed << std::setprecision(1)
+            << std::setw(8) << neighbours / steps << std::setprecision(2) << std::setw(7) << iterations / steps
+            << std::setprecision(1) << std::setw(10) << build * 1000.0 / steps << std::setw(10) << search * 1000.0 / steps
+            << std::setw(10) << density * 1000.0 / steps << std::setw(10) << forces * 1000.0 / steps
+            << std::setw(10) << step * 1000.0 / steps << std::scientific << std::setprecision(2)
+            << std::setw(12) << n * steps / step << std::defaultfloat << std::endl;
+    }
+}
+
+inline int runBenchmarks(int argc, char* argv[])
+{
+    BenchOptions options;
+    std::string suite = "step";
+    bool solverGiven = false;
+
+    for (int i = 0; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--steps" && i + 1 < argc)
+            options.steps = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--solver" && i + 1 < argc)
+        {
+            options.solver = parseForceSolver(argv[++i]);
+            solverGiven = true;
+        }
+        else if (arg == "--theta" && i + 1 < argc)
+            options.theta = (float)std::atof(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--pin")
+            options.pin = true;
+        else if (arg == "--reorder" && i + 1 < argc)
+            options.reorderInterval = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--integrator" && i + 1 < argc)
+            options.integrator = std::string(argv[++i]) == "hermite" ? Integrator::Hermite : Integrator::Leapfrog;
+        else if (arg == "--block")
+            options.blockTimesteps = true;
+        else if (arg == "--max-level" && i + 1 < argc)
+            options.maxLevel = std::min(std::max(std::atoi(argv[++i]), 0), 20);
+        else if (arg == "--grid" && i + 1 < argc)
+            options.gridSize = ParticleMesh::roundGridSize(std::atoi(argv[++i]));
+        else if (arg == "--split" && i + 1 < argc)
+            options.splitCells = std::max((float)std::atof(argv[++i]), 0.25f);
+        else if (arg == "--order" && i + 1 < argc)
+            options.order = std::min(std::max(std::atoi(argv[++i]), 1), 8);
+        else if (arg == "--refit")
+        {
+            // the growth threshold is optional, a bare number after it would be a body count
+            options.refitGrowth = 1.5f;
+            if (i + 1 < argc && std::strchr(argv[i + 1], '.'))
+                options.refitGrowth = std::max((float)std::atof(argv[++i]), 1.0f);
+        }
+        else if (arg == "--group" && i + 1 < argc)
+            options.groupSize = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--tolerance" && i + 1 < argc)
+            options.errorTolerance = std::max((float)std::atof(argv[++i]), 0.0f);
+        else if (arg == "--samples" && i + 1 < argc)
+            options.samples = std::max<size_t>(1, (size_t)std::strtoull(argv[++i], nullptr, 10));
+        else if (!arg.empty() && std::isdigit((unsigned char)arg[0]))
+            options.counts.push_back((size_t)std::strtoull(arg.c_str(), nullptr, 10));
+        else
+            suite = arg;
+    }
+
+    if (options.threads != 0 || options.pin)
+        configureThreadPool(options.threads, options.pin);
+
+    if (suite == "step")
+    {
+        if (options.counts.empty())
+            options.counts = { 1000, 10000, 100000 };
+        std::string name = forceSolverName(options.solver);
+        name[0] = (char)std::toupper((unsigned char)name[0]);
+        std::cout << name
+            << (options.gridSize > 0 && (options.solver == ForceSolver::ParticleMesh || options.solver == ForceSolver::TreePM)
+                ? " " + std::to_string(options.gridSize) + "^3" : "")
+            << (options.integrator == Integrator::Hermite ? ", Hermite (direct)" : ", kick-drift-kick leapfrog")
+            << " (" << options.steps << " steps"
+            << (options.blockTimesteps ? ", block timesteps" : "") << ")" << std::endl;
+        for (size_t count : options.counts)
+        {
+            if (count >= 2)
+                benchStepCost(count, options);
+        }
+    }
+    else if (suite == "solvers")
+    {
+        if (options.counts.empty())
+            options.counts = { 10000, 100000, 1000000 };
+        std::cout << "Force evaluation, direct vs Barnes-Hut (theta " << options.theta
+            << ", quadrupole); * = direct timed on a subset of targets and scaled to N" << std::endl;
+        for (size_t count : options.counts)
+        {
+            if (count >= 2)
+                benchSolvers(count, options);
+        }
+    }
+    else if (suite == "kernels")
+    {
+        benchKernels(options.counts.empty() ? 4096 : options.counts[0]);
+    }
+    else if (suite == "threads")
+    {
+        benchThreads(options.counts.empty() ? 1000000 : options.counts[0], options,
+            solverGiven ? options.solver : ForceSolver::BarnesHut);
+    }
+    else if (suite == "hermite")
+    {
+        benchHermite(options.counts.empty() ? 1000 : options.counts[0]);
+    }
+    else if (suite == "pm")
+    {
+        benchParticleMesh(options.counts.empty() ? 100000 : options.counts[0]);
+    }
+    else if (suite == "treepm")
+    {
+        benchTreePM(options.counts.empty() ? 100000 : options.counts[0], options);
+    }
+    else if (suite == "fmm")
+    {
+        benchFMM(options.counts.empty() ? 100000 : options.counts[0], options);
+    }
+    else if (suite == "refit")
+    {
+        benchRefit(options.counts.empty() ? 100000 : options.counts[0], options);
+    }
+    else if (suite == "groups")
+    {
+        benchGroups(options.counts.empty() ? 100000 : options.counts[0], options);
+    }
+    else if (suite == "ewald")
+    {
+        benchEwald(options.counts.empty() ? 20000 : options.counts[0]);
+    }
+    else if (suite == "sph")
+    {
+        benchSPH(options.counts.empty() ? std::vector<size_t>{ 100000, 1000000 } : options.counts);
+    }
+    else if (suite == "comoving")
+    {
+        benchComoving(options);
+    }
+    else if (suite == "accuracy")
+    {
+        benchAccuracy(options.counts.empty() ? 100000 : options.counts[0], options);
+    }
+    else if (suite == "order")
+    {
+        benchOrder(options.counts.empty() ? 1000000 : options.counts[0], options);
+    }
+    else
+    {
+        std::cout << "Unknown benchmark suite: " << suite << std::endl;
+        return 1;
+    }
+    return 0;
+}
+#endif
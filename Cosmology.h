@@ -0,0 +1,123 @@
+#ifndef COSMOLOGY_H
+#define COSMOLOGY_H
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// Friedmann background for comoving runs, in simulation units: H(a) with
+// the matter, curvature and vacuum terms. With G, a box of side L and total
+// mass M, the Hubble constant is not free: 3 H0^2 omegaMatter = 8 pi G M / L^3
+// (see hubbleFor).
+// ------------------------------------------------------------------------
+struct Cosmology
+{
+    double hubble = 1.0;      // H0, per unit simulation time
+    double omegaMatter = 1.0;
+    double omegaLambda = 0.0; // curvature takes up the rest
+
+    double H(double a) const
+    {
+        const double omegaCurvature = 1.0 - omegaMatter - omegaLambda;
+        return hubble * std::sqrt(omegaMatter / (a * a * a) + omegaCurvature / (a * a) + omegaLambda);
+    }
+
+    // H0 of a universe whose mean comoving matter density is `density`
+    static double hubbleFor(double G, double density, double omegaMatter)
+    {
+        const double pi = 3.14159265358979323846;
+        return std::sqrt(8.0 * pi * G * density / (3.0 * omegaMatter));
+    }
+
+    bool operator==(const Cosmology& o) const
+    {
+        return hubble == o.hubble && omegaMatter == o.omegaMatter && omegaLambda == o.omegaLambda;
+    }
+};
+
+// Drift and kick factors of the comoving leapfrog (GADGET-2). With
+// canonical momenta w = a^2 dx/dt a step from a1 to a2 needs
+//   drift  Integral dt / a^2 = Integral dln(a) / (a^2 H)
+//   kick   Integral dt / a   = Integral dln(a) / (a H)
+// plus the elapsed cosmic time Integral dln(a) / H for the clock. The
+// running integrals are tabulated once in ln(a) by Gauss-Legendre
+// quadrature and read back with cubic Hermite interpolation, whose slopes
+// are the integrands themselves, so a factor costs two table reads.
+// ------------------------------------------------------------------------
+class CosmologyTables
+{
+public:
+    static const int length = 1024;
+
+    // tables from aBegin to aEnd for the given background
+    void build(const Cosmology& c, double aBegin, double aEnd)
+    {
+        cosmology = c;
+        lnBegin = std::log(aBegin);
+        step = (std::log(aEnd) - lnBegin) / (length - 1);
+
+        // 4-point Gauss-Legendre on each interval, nodes and weights on [-1, 1]
+        const double nodes[4] = { -0.8611363115940526, -0.3399810435848563, 0.3399810435848563, 0.8611363115940526 };
+        const double weights[4] = { 0.3478548451374538, 0.6521451548625461, 0.6521451548625461, 0.3478548451374538 };
+
+        for (int t = 0; t < 3; t++)
+        {
+            sums[t].assign(length, 0.0);
+            slopes[t].assign(length, 0.0);
+        }
+        for (int i = 0; i < length; i++)
+        {
+            integrands(lnBegin + i * step, slopes[0][i], slopes[1][i], slopes[2][i]);
+            if (i == 0)
+                continue;
+            double part[3] = { 0.0, 0.0, 0.0 };
+            for (int k = 0; k < 4; k++)
+            {
+                double f[3];
+                integrands(lnBegin + (i - 0.5 + 0.5 * nodes[k]) * step, f[0], f[1], f[2]);
+                for (int t = 0; t < 3; t++)
+                    part[t] += 0.5 * step * weights[k] * f[t];
+            }
+            for (int t = 0; t < 3; t++)
+                sums[t][i] = sums[t][i - 1] + part[t];
+        }
+        aLow = aBegin;
+        aHigh = aEnd;
+    }
+
+    bool covers(const Cosmology& c, double a1, double a2) const
+    {
+        return !sums[0].empty() && cosmology == c && a1 >= aLow && a2 <= aHigh;
+    }
+
+    double drift(double a1, double a2) const { return running(0, a2) - running(0, a1); }
+    double kick(double a1, double a2) const { return running(1, a2) - running(1, a1); }
+    double time(double a1, double a2) const { return running(2, a2) - running(2, a1); }
+
+private:
+    Cosmology cosmology;
+    double lnBegin = 0.0, step = 1.0;
+    double aLow = 0.0, aHigh = 0.0;
+    std::vector<double> sums[3], slopes[3]; // drift, kick, time; slopes are d/dln(a)
+
+    void integrands(double lnA, double& drift, double& kick, double& time) const
+    {
+        const double a = std::exp(lnA);
+        time = 1.0 / cosmology.H(a);
+        kick = time / a;
+        drift = kick / a;
+    }
+
+    // running integral from aLow to a
+    double running(int t, double a) const
+    {
+        double u = (std::log(a) - lnBegin) / step;
+        int i = std::min(std::max((int)std::floor(u), 0), length - 2);
+        double s = u - i;
+        double s2 = s * s, s3 = s2 * s;
+        return (2.0 * s3 - 3.0 * s2 + 1.0) * sums[t][i] + (s3 - 2.0 * s2 + s) * step * slopes[t][i]
+            + (-2.0 * s3 + 3.0 * s2) * sums[t][i + 1] + (s3 - s2) * step * slopes[t][i + 1];
+    }
+};
+#endif
@@ -0,0 +1,292 @@
+#ifndef EWALD_H
+#define EWALD_H
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+// Periodic boundaries: the simulation volume is the cube [0, L)^3 repeated
+// in every direction, against a uniform neutralising background. A body
+// sees each other body at its nearest image, and the Ewald correction adds
+// what all the remaining images contribute:
+//   a = m (d / |d|^3 + t(d))
+// with d the minimum-image separation (source - target). t is smooth over
+// the cube, so it is tabulated once and interpolated trilinearly.
+// ------------------------------------------------------------------------
+
+// separation folded into [-L/2, L/2]
+inline float periodicDelta(float d, float boxSize)
+{
+    return d - boxSize * std::nearbyint(d / boxSize);
+}
+
+inline glm::vec3 periodicDelta(const glm::vec3& d, float boxSize)
+{
+    return glm::vec3(periodicDelta(d.x, boxSize), periodicDelta(d.y, boxSize), periodicDelta(d.z, boxSize));
+}
+
+// position folded into [0, L)
+inline float periodicWrap(float x, float boxSize)
+{
+    x -= boxSize * std::floor(x / boxSize);
+    return x < boxSize ? x : 0.0f;
+}
+
+// Correction field of a unit mass in a unit box, tabulated over one octant,
+// [0, 1/2]^3, at (cells + 1)^3 points; the other octants follow by symmetry
+// (t is odd along its own axis and even along the other two). Each point
+// holds tx, ty, tz and the potential correction. The table is ~4 MB and takes
+// seconds to sum, so open() first tries to map a cached copy from disk and
+// only computes (and caches) it when that fails.
+class EwaldTable
+{
+public:
+    static const int cells = 64;
+    static const uint32_t version = 1;
+
+    // how the table got here, for the logs
+    bool fromCache = false;
+    double seconds = 0.0;     // computing or mapping it
+    std::string cachePath;
+    bool cacheWritten = false;
+
+    EwaldTable() {}
+
+    explicit EwaldTable(const std::string& path)
+    {
+        open(path);
+    }
+
+    EwaldTable(const EwaldTable&) = delete;
+    EwaldTable& operator=(const EwaldTable&) = delete;
+
+    // map the cache at path, or compute the table and try to write the cache;
+    // an empty path never touches the disk
+    // ------------------------------------------------------------------------
+    void open(const std::string& path)
+    {
+        auto start = std::chrono::steady_clock::now();
+        cachePath = path;
+        fromCache = !path.empty() && map(path);
+        if (!fromCache)
+        {
+            compute();
+            cacheWritten = !path.empty() && save(path);
+            // map what was just written, so every later process shares the pages
+            if (cacheWritten && map(path))
+                std::vector<float>().swap(owned);
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // sum every point in parallel, into memory
+    void compute()
+    {
+        file.close();
+        const int n = cells + 1;
+        owned.assign((size_t)n * n * n * 4, 0.0f);
+        parallelFor(0, (size_t)n * n * n, [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                glm::dvec3 u((double)(k % n), (double)(k / n % n), (double)(k / n / n));
+                glm::dvec4 v = exact(u * (0.5 / cells));
+                for (int c = 0; c < 4; c++)
+                    owned[4 * k + c] = (float)v[c];
+            }
+        }, 64);
+        values = owned.data();
+    }
+
+    bool save(const std::string& path) const
+    {
+        // write aside and rename, so a concurrent reader never maps half a table
+        const std::string temp = path + ".tmp";
+        {
+            std::ofstream out(temp, std::ios::binary);
+            if (!out)
+                return false;
+            Header header = makeHeader();
+            out.write((const char*)&header, sizeof(header));
+            out.write((const char*)values, (std::streamsize)(valueCount() * sizeof(float)));
+            if (!out)
+                return false;
+        }
+        std::remove(path.c_str());
+        return std::rename(temp.c_str(), path.c_str()) == 0;
+    }
+
+    bool ready() const
+    {
+        return values != nullptr;
+    }
+
+    // correction to the acceleration from a unit mass at minimum-image separation d
+    // ------------------------------------------------------------------------
+    glm::vec3 acceleration(const glm::vec3& d, float boxSize) const
+    {
+        glm::vec4 v = sample(glm::abs(d) / boxSize);
+        glm::vec3 t(d.x < 0.0f ? -v.x : v.x, d.y < 0.0f ? -v.y : v.y, d.z < 0.0f ? -v.z : v.z);
+        return t / (boxSize * boxSize);
+    }
+
+    // correction to the potential -1/|d| of a unit mass; at d = 0 this is the
+    // interaction of a body with its own images
+    float potential(const glm::vec3& d, float boxSize) const
+    {
+        return sample(glm::abs(d) / boxSize).w / boxSize;
+    }
+
+    // Ewald sum in a unit box at u (not at u = 0 unless all of it is 0):
+    // tx, ty, tz and the potential correction, in double. alpha = 2 splits
+    // the sum so both the real and the reciprocal series converge by |n|,|h| = 4.
+    // ------------------------------------------------------------------------
+    static glm::dvec4 exact(const glm::dvec3& u)
+    {
+        const double pi = 3.14159265358979323846, alpha = 2.0;
+        const double r = glm::length(u);
+        glm::dvec3 g(0.0);
+        double phi = pi / (alpha * alpha);
+
+        for (int nx = -4; nx <= 4; nx++)
+            for (int ny = -4; ny <= 4; ny++)
+                for (int nz = -4; nz <= 4; nz++)
+                {
+                    glm::dvec3 d = u - glm::dvec3(nx, ny, nz);
+                    double rn = glm::length(d);
+                    if (rn == 0.0 || rn > 3.5)
+                        continue;
+                    double val = std::erfc(alpha * rn) + 2.0 * alpha * rn / std::sqrt(pi) * std::exp(-alpha * alpha * rn * rn);
+                    g -= d * (val / (rn * rn * rn));
+                    phi -= std::erfc(alpha * rn) / rn;
+                }
+
+        for (int hx = -4; hx <= 4; hx++)
+            for (int hy = -4; hy <= 4; hy++)
+                for (int hz = -4; hz <= 4; hz++)
+                {
+                    int h2 = hx * hx + hy * hy + hz * hz;
+                    if (h2 == 0 || h2 > 16)
+                        continue;
+                    glm::dvec3 h(hx, hy, hz);
+                    double k = std::exp(-pi * pi * h2 / (alpha * alpha)) / h2;
+                    double phase = 2.0 * pi * glm::dot(h, u);
+                    g -= h * (2.0 * k * std::sin(phase));
+                    phi -= k / pi * std::cos(phase);
+                }
+
+        // take out the nearest image itself; at u = 0 only its smooth limit is left
+        if (r > 0.0)
+        {
+            g += u / (r * r * r);
+            phi += 1.0 / r;
+        }
+        else
+        {
+            phi += 2.0 * alpha / std::sqrt(pi);
+        }
+
+        // g is the field of the source at u relative to the target, so flip it
+        // for the acceleration towards the source
+        return glm::dvec4(-g, phi);
+    }
+
+private:
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t cells;
+        uint32_t floatSize;
+        double alpha;
+    };
+
+    MappedFile file;
+    std::vector<float> owned;
+    const float* values = nullptr;
+
+    static Header makeHeader()
+    {
+        Header header;
+        std::memcpy(header.magic, "GEWD", 4);
+        header.version = version;
+        header.cells = cells;
+        header.floatSize = sizeof(float);
+        header.alpha = 2.0;
+        return header;
+    }
+
+    static size_t valueCount()
+    {
+        const size_t n = cells + 1;
+        return n * n * n * 4;
+    }
+
+    bool map(const std::string& path)
+    {
+        if (!file.open(path))
+            return false;
+        Header expected = makeHeader(), found;
+        if (file.size() != sizeof(Header) + valueCount() * sizeof(float))
+        {
+            file.close();
+            return false;
+        }
+        std::memcpy(&found, file.data(), sizeof(Header));
+        if (std::memcmp(&found, &expected, sizeof(Header)) != 0)
+        {
+            file.close();
+            return false;
+        }
+        values = (const float*)(file.data() + sizeof(Header));
+        return true;
+    }
+
+    // trilinear interpolation at u in [0, 1/2]^3
+    glm::vec4 sample(const glm::vec3& u) const
+    {
+        const int n = cells + 1;
+        glm::vec3 f = glm::min(u * (2.0f * cells), glm::vec3((float)cells));
+        glm::ivec3 i = glm::min(glm::ivec3(f), glm::ivec3(cells - 1));
+        glm::vec3 w = f - glm::vec3(i);
+
+        const float* p = values + 4 * (((size_t)i.z * n + i.y) * n + i.x);
+        const size_t sy = 4 * (size_t)n, sz = 4 * (size_t)n * n;
+        glm::vec4 c[8];
+        for (int k = 0; k < 8; k++)
+        {
+            const float* q = p + ((k & 1) ? 4 : 0) + ((k & 2) ? sy : 0) + ((k & 4) ? sz : 0);
+            c[k] = glm::vec4(q[0], q[1], q[2], q[3]);
+        }
+        glm::vec4 x0 = glm::mix(c[0], c[1], w.x), x1 = glm::mix(c[2], c[3], w.x);
+        glm::vec4 x2 = glm::mix(c[4], c[5], w.x), x3 = glm::mix(c[6], c[7], w.x);
+        return glm::mix(glm::mix(x0, x1, w.y), glm::mix(x2, x3, w.y), w.z);
+    }
+};
+
+// Cache file of the shared table; set before the first periodic force
+// evaluation, an empty path keeps it in memory only.
+inline std::string& ewaldCachePath()
+{
+    static std::string path = "ewald_table.bin";
+    return path;
+}
+
+// the process-wide table, opened on first use
+inline const EwaldTable& ewaldTable()
+{
+    static const EwaldTable table(ewaldCachePath());
+    return table;
+}
+#endif
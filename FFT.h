@@ -0,0 +1,241 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "ThreadPool.h"
+
+// Small self-contained FFTs for the particle-mesh solver: an iterative
+// radix-2 complex transform, a real-to-complex transform built on a
+// half-length complex one, and an in-place 3D real transform over a padded
+// grid. Sizes must be powers of two. Inverse transforms are unnormalised,
+// so forward followed by inverse scales the data by the number of points.
+// ------------------------------------------------------------------------
+
+typedef std::complex<float> Complex;
+
+class FFTPlan
+{
+public:
+    explicit FFTPlan(size_t n = 1)
+        : n(n), twiddle(n / 2), bitReverse(n)
+    {
+        const double pi = 3.14159265358979323846;
+        for (size_t k = 0; k < n / 2; k++)
+            twiddle[k] = Complex((float)std::cos(-2.0 * pi * k / n), (float)std::sin(-2.0 * pi * k / n));
+
+        int bits = 0;
+        while (((size_t)1 << bits) < n)
+            bits++;
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t r = 0;
+            for (int b = 0; b < bits; b++)
+                r |= ((i >> b) & 1) << (bits - 1 - b);
+            bitReverse[i] = (uint32_t)r;
+        }
+    }
+
+    size_t size() const
+    {
+        return n;
+    }
+
+    // in place; inverse uses the conjugate twiddles
+    void transform(Complex* data, bool inverse) const
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t r = bitReverse[i];
+            if (i < r)
+                std::swap(data[i], data[r]);
+        }
+
+        for (size_t len = 2; len <= n; len <<= 1)
+        {
+            const size_t half = len / 2;
+            const size_t stride = n / len;
+            for (size_t start = 0; start < n; start += len)
+            {
+                for (size_t k = 0; k < half; k++)
+                {
+                    Complex w = inverse ? std::conj(twiddle[k * stride]) : twiddle[k * stride];
+                    Complex t = w * data[start + k + half];
+                    data[start + k + half] = data[start + k] - t;
+                    data[start + k] += t;
+                }
+            }
+        }
+    }
+
+    // e^{-2 pi i k / n} for k < n / 2
+    const Complex& root(size_t k) const
+    {
+        return twiddle[k];
+    }
+
+private:
+    size_t n;
+    std::vector<Complex> twiddle;
+    std::vector<uint32_t> bitReverse;
+};
+
+// n real values <-> n/2 + 1 complex values in the same buffer of n + 2
+// floats. The even/odd samples are packed into one n/2-point complex
+// transform and untangled with the twiddles of the full length.
+class RealFFTPlan
+{
+public:
+    explicit RealFFTPlan(size_t n = 2)
+        : n(n), half(n / 2), full(n)
+    {
+    }
+
+    size_t size() const
+    {
+        return n;
+    }
+
+    void forward(float* inout) const
+    {
+        const size_t m = n / 2;
+        Complex* z = reinterpret_cast<Complex*>(inout);
+        half.transform(z, false);
+
+        Complex z0 = z[0];
+        z[m] = Complex(z0.real() - z0.imag(), 0.0f);
+        z[0] = Complex(z0.real() + z0.imag(), 0.0f);
+        for (size_t k = 1; k <= m / 2; k++)
+        {
+            size_t j = m - k;
+            Complex a = z[k], b = std::conj(z[j]);
+            Complex even = 0.5f * (a + b);
+            Complex odd = Complex(0.0f, -0.5f) * (a - b);
+            Complex xk = even + full.root(k) * odd;
+            // X[m - k] = conj(even) - conj(w^k odd), since w^(m-k) = -conj(w^k)
+            Complex xj = std::conj(even) - std::conj(full.root(k) * odd);
+            z[k] = xk;
+            z[j] = xj;
+        }
+    }
+
+    // returns n times the original samples
+    void inverse(float* inout) const
+    {
+        const size_t m = n / 2;
+        Complex* z = reinterpret_cast<Complex*>(inout);
+
+        Complex x0 = z[0], xm = z[m];
+        z[0] = Complex(x0.real() + xm.real(), x0.real() - xm.real());
+        for (size_t k = 1; k <= m / 2; k++)
+        {
+            size_t j = m - k;
+            Complex a = z[k], b = std::conj(z[j]);
+            Complex even = a + b;
+            Complex odd = (a - b) * std::conj(full.root(k));
+            Complex zk = even + Complex(0.0f, 1.0f) * odd;
+            // same with k and j swapped: even -> conj(even), odd -> conj(odd)
+            Complex zj = std::conj(even) + Complex(0.0f, 1.0f) * std::conj(odd);
+            z[k] = zk;
+            z[j] = zj;
+        }
+        half.transform(z, true);
+    }
+
+private:
+    size_t n;
+    FFTPlan half;
+    FFTPlan full;
+};
+
+// In-place 3D real FFT over an n x n x n grid stored with x fastest and each
+// x row padded to n + 2 floats (the FFTW r2c layout). After forward() the
+// grid holds (n/2 + 1) x n x n complex values; inverse() takes it back.
+class RealFFT3D
+{
+public:
+    explicit RealFFT3D(size_t n = 2)
+        : n(n), rows(n), columns(n)
+    {
+    }
+
+    size_t size() const
+    {
+        return n;
+    }
+
+    // floats per padded x row
+    size_t rowStride() const
+    {
+        return n + 2;
+    }
+
+    size_t floatCount() const
+    {
+        return rowStride() * n * n;
+    }
+
+    // `extent` < n says only y, z < extent can be non-zero on input (forward)
+    // or are needed on output (inverse), as with a zero-padded convolution;
+    // rows and y columns outside that block are skipped
+    void forward(float* grid, size_t extent = 0) const
+    {
+        extent = extent == 0 ? n : extent;
+        parallelFor(0, extent * extent, [&](size_t b, size_t e)
+        {
+            for (size_t r = b; r < e; r++)
+                rows.forward(grid + ((r / extent) * n + r % extent) * rowStride());
+        }, 16);
+        transformColumns(grid, false, extent);
+    }
+
+    void inverse(float* grid, size_t extent = 0) const
+    {
+        extent = extent == 0 ? n : extent;
+        transformColumns(grid, true, extent);
+        parallelFor(0, extent * extent, [&](size_t b, size_t e)
+        {
+            for (size_t r = b; r < e; r++)
+                rows.inverse(grid + ((r / extent) * n + r % extent) * rowStride());
+        }, 16);
+    }
+
+private:
+    size_t n;
+    RealFFTPlan rows;
+    FFTPlan columns;
+
+    // complex transforms along y and then z (reverse order for the inverse),
+    // gathering each strided line into a contiguous buffer; y lines only for z < extent
+    void transformColumns(float* grid, bool inverse, size_t extent) const
+    {
+        Complex* c = reinterpret_cast<Complex*>(grid);
+        const size_t kx = n / 2 + 1;     // complex values per row
+        const size_t plane = kx * n;     // complex values per z plane
+
+        for (int pass = 0; pass < 2; pass++)
+        {
+            const bool alongY = (pass == 0) != inverse;
+            parallelFor(0, kx * (alongY ? extent : n), [&](size_t b, size_t e)
+            {
+                std::vector<Complex> line(n);
+                for (size_t l = b; l < e; l++)
+                {
+                    size_t x = l % kx, other = l / kx;
+                    size_t base = alongY ? x + other * plane : x + other * kx;
+                    size_t stride = alongY ? kx : plane;
+                    for (size_t i = 0; i < n; i++)
+                        line[i] = c[base + i * stride];
+                    columns.transform(line.data(), inverse);
+                    for (size_t i = 0; i < n; i++)
+                        c[base + i * stride] = line[i];
+                }
+            }, 16);
+        }
+    }
+};
+#endif
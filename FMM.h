@@ -0,0 +1,633 @@
+#ifndef FMM_H
+#define FMM_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <utility>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "ParticleStore.h"
+#include "Octree.h"
+#include "GravityKernels.h"
+#include "ThreadPool.h"
+
+// Cartesian Taylor expansions of the softened kernel F = (r^2 + eps^2)^(-1/2)
+// up to order p (Dehnen 2002, 2014). Coefficients are indexed by
+// multi-indices n = (a, b, c) with |n| = a + b + c <= p, sorted by degree.
+// With d^n = dx^a dy^b dz^c and n! = a! b! c!:
+//   multipole about z:   M_n = sum_j m_j (z - x_j)^n / n!
+//   M2L from zB to zA:   L_k += sum_n M_n D_{n+k}(zA - zB),  |n| + |k| <= p
+//   field at zA + t:     a_i = sum_k t^k / k! L_{k+e_i}
+// where D_n are the derivatives of F. Using the softened kernel keeps the
+// far field consistent with the softened near field.
+// ------------------------------------------------------------------------
+class CartesianExpansion
+{
+public:
+    int order = 0;
+    int count = 0; // coefficients with |n| <= order
+
+    // out[term.out] += a[term.a] * b[term.b]
+    struct Term
+    {
+        int out, a, b;
+    };
+    std::vector<Term> multipoleShift; // M[n] += P[n - s] * Mchild[s]
+    std::vector<Term> localShift;     // Lchild[k] += P[n - k] * L[n]
+    std::vector<Term> fieldTerms[3];  // a_i += P[k] * L[k + e_i]
+
+    explicit CartesianExpansion(int p = 4)
+        : order(p), lookup((size_t)(p + 1) * (p + 1) * (p + 1), -1)
+    {
+        for (int l = 0; l <= p; l++)
+            for (int a = l; a >= 0; a--)
+                for (int b = l - a; b >= 0; b--)
+                {
+                    lookup[((size_t)a * (p + 1) + b) * (p + 1) + (l - a - b)] = count++;
+                    exponent.push_back(glm::ivec3(a, b, l - a - b));
+                }
+
+        // recurrence links: strip one power from the first non-zero axis
+        parent.assign(count, 0);
+        grand.assign(count, -1);
+        axis.assign(count, 0);
+        for (int n = 1; n < count; n++)
+        {
+            glm::ivec3 e = exponent[n];
+            int i = e.x > 0 ? 0 : e.y > 0 ? 1 : 2;
+            axis[n] = i;
+            e[i]--;
+            parent[n] = index(e);
+            if (e[i] > 0)
+            {
+                e[i]--;
+                grand[n] = index(e);
+            }
+        }
+
+        // M2L: coefficients are sorted by degree, so the n with |n| <= p - |k|
+        // are a prefix of M and only D needs an index map
+        m2lStart.push_back(0);
+        for (int k = 0; k < count; k++)
+        {
+            for (int n = 0; n < count && degree(n) <= p - degree(k); n++)
+                m2lIndex.push_back(index(exponent[k] + exponent[n]));
+            m2lStart.push_back((int)m2lIndex.size());
+        }
+
+        for (int k = 0; k < count; k++)
+        {
+            for (int n = 0; n < count; n++)
+            {
+                const glm::ivec3 ek = exponent[k], en = exponent[n];
+                if (en.x >= ek.x && en.y >= ek.y && en.z >= ek.z)
+                {
+                    multipoleShift.push_back({ n, index(en - ek), k });
+                    localShift.push_back({ k, index(en - ek), n });
+                }
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                if (degree(k) < p)
+                {
+                    glm::ivec3 e = exponent[k];
+                    e[i]++;
+                    fieldTerms[i].push_back({ i, k, index(e) });
+                }
+            }
+        }
+    }
+
+    int degree(int n) const
+    {
+        return exponent[n].x + exponent[n].y + exponent[n].z;
+    }
+
+    int index(const glm::ivec3& e) const
+    {
+        return lookup[((size_t)e.x * (order + 1) + e.y) * (order + 1) + e.z];
+    }
+
+    // out[n] = d^n / n!
+    void scaledPowers(const glm::dvec3& d, double* out) const
+    {
+        out[0] = 1.0;
+        for (int n = 1; n < count; n++)
+            out[n] = out[parent[n]] * d[axis[n]] / exponent[n][axis[n]];
+    }
+
+    // D_n(r) for |n| <= order. With F^(m) the m-th derivative of F in r^2 / 2,
+    //   T^(m)_0 = F^(m),  T^(m)_{n+e_i} = r_i T^(m+1)_n + n_i T^(m+1)_{n-e_i},  D_n = T^(0)_n.
+    // work must hold count * (order + 1) doubles.
+    void derivatives(const glm::dvec3& r, double eps2, double* D, double* work) const
+    {
+        const int p1 = order + 1;
+        const double invR2 = 1.0 / (glm::dot(r, r) + eps2);
+        double f = std::sqrt(invR2);
+        for (int m = 0; m <= order; m++)
+        {
+            work[m] = f;
+            f *= -(2.0 * m + 1.0) * invR2;
+        }
+        for (int n = 1; n < count; n++)
+        {
+            const int i = axis[n];
+            const double* tp = work + (size_t)parent[n] * p1;
+            double* t = work + (size_t)n * p1;
+            const int top = order - degree(n);
+            if (grand[n] >= 0)
+            {
+                const double* tg = work + (size_t)grand[n] * p1;
+                const double c = exponent[n][i] - 1;
+                for (int m = 0; m <= top; m++)
+                    t[m] = r[i] * tp[m + 1] + c * tg[m + 1];
+            }
+            else
+            {
+                for (int m = 0; m <= top; m++)
+                    t[m] = r[i] * tp[m + 1];
+            }
+        }
+        for (int n = 0; n < count; n++)
+            D[n] = work[(size_t)n * p1];
+    }
+
+    // L_k += sum_n M_n D_{n+k}
+    void m2l(const double* M, const double* D, double* L) const
+    {
+        for (int k = 0; k < count; k++)
+        {
+            const int* map = &m2lIndex[m2lStart[k]];
+            const int terms = m2lStart[k + 1] - m2lStart[k];
+            double sum = 0.0;
+            for (int n = 0; n < terms; n++)
+                sum += M[n] * D[map[n]];
+            L[k] += sum;
+        }
+    }
+
+    // multiply-adds per M2L
+    size_t m2lCost() const
+    {
+        return m2lIndex.size();
+    }
+
+    static void apply(const std::vector<Term>& terms, double* out, const double* a, const double* b)
+    {
+        for (const Term& t : terms)
+            out[t.out] += a[t.a] * b[t.b];
+    }
+
+private:
+    std::vector<int> lookup;
+    std::vector<glm::ivec3> exponent;
+    std::vector<int> parent, grand, axis;
+    std::vector<int> m2lIndex, m2lStart;
+};
+
+// Fast multipole method on the Barnes-Hut octree. Every cell gets a
+// multipole about its centre of mass and a radius enclosing its bodies. A
+// mutual dual-tree walk pairs cells: well-separated pairs,
+// |zA - zB| > (rA + rB) / theta, interact through M2L in both directions,
+// and pairs of leaves that are too close are summed directly. Locals are
+// then pushed down the tree and evaluated at the bodies. The cost is O(N)
+// for a fixed order and theta; the error falls roughly like theta^p.
+//
+// The walk only records pairs: its top levels are split serially, the rest
+// runs as one task per top-level pair. The pairs are then grouped by
+// receiving cell, so M2L and the direct sums run in parallel with every
+// cell written by one task. M2M and L2L go level by level, in parallel
+// within a level, and the direct sums use the SIMD gravity kernels.
+class FastMultipole
+{
+public:
+    int order = 4;               // expansion order p, 1..8
+    float theta = 0.5f;          // acceptance ratio of the dual walk
+    unsigned int leafSize = 16;  // bodies per leaf
+    float directFactor = 0.5f;   // leaf pairs with nA nB <= directFactor * (M2L terms) skip the expansion
+
+    // seconds per phase of the last evaluation
+    struct Timings
+    {
+        double build = 0.0, upward = 0.0, walk = 0.0, m2l = 0.0, downward = 0.0;
+    } timings;
+
+    // directed interactions of the last evaluation
+    size_t cellInteractions = 0, leafInteractions = 0;
+
+    // accelerations (without G) for every particle into ax/ay/az
+    // ------------------------------------------------------------------------
+    void accelerations(ParticleStore& p, float softening)
+    {
+        evaluate(p, softening);
+        parallelFor(0, tree.index.size(), [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                unsigned int i = tree.index[k];
+                p.ax[i] = accX[k];
+                p.ay[i] = accY[k];
+                p.az[i] = accZ[k];
+            }
+        }, 16384);
+    }
+
+    // the expansion is global, so everyone is evaluated and only the targets written
+    void accelerations(ParticleStore& p, float softening, const std::vector<uint32_t>& targets)
+    {
+        evaluate(p, softening);
+        rank.resize(tree.index.size());
+        for (size_t k = 0; k < tree.index.size(); k++)
+            rank[tree.index[k]] = (uint32_t)k;
+        parallelFor(0, targets.size(), [&](size_t b, size_t e)
+        {
+            for (size_t t = b; t < e; t++)
+            {
+                uint32_t i = targets[t], k = rank[i];
+                p.ax[i] = accX[k];
+                p.ay[i] = accY[k];
+                p.az[i] = accZ[k];
+            }
+        }, 4096);
+    }
+
+private:
+    Octree tree;
+    CartesianExpansion expansion;
+
+    std::vector<glm::dvec3> centre;            // expansion centre (com) per cell
+    std::vector<double> radius;                // bodies lie within radius of the centre
+    std::vector<double> multipole, local;      // count coefficients per cell
+    std::vector<float> sx, sy, sz, sm;         // bodies in tree order
+    std::vector<float> accX, accY, accZ;       // results in tree order
+    std::vector<uint32_t> rank;
+
+    // interaction lists grouped by receiving cell: sources of cell c are
+    // cellList[cellStart[c] .. cellStart[c + 1]), same for leaves
+    typedef std::vector<std::pair<uint32_t, uint32_t>> Pairs;
+    Pairs cellPairs, leafPairs;
+    std::vector<uint32_t> cellStart, cellList, leafStart, leafList;
+
+    // cells sorted by depth: level c holds byLevel[levelStart[c] .. levelStart[c + 1])
+    std::vector<uint32_t> levelStart, byLevel;
+
+    typedef std::chrono::steady_clock Clock;
+    static double since(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // ------------------------------------------------------------------------
+    void evaluate(const ParticleStore& p, float softening)
+    {
+        const int p0 = std::min(std::max(order, 1), 8);
+        if (expansion.order != p0)
+            expansion = CartesianExpansion(p0);
+        const double eps2 = (double)softening * softening;
+
+        auto start = Clock::now();
+        tree.leafSize = leafSize;
+        tree.build(p);
+        const size_t n = tree.index.size();
+        sx.resize(n);
+        sy.resize(n);
+        sz.resize(n);
+        sm.resize(n);
+        accX.assign(n, 0.0f);
+        accY.assign(n, 0.0f);
+        accZ.assign(n, 0.0f);
+        parallelFor(0, n, [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                unsigned int i = tree.index[k];
+                sx[k] = p.x[i];
+                sy[k] = p.y[i];
+                sz[k] = p.z[i];
+                sm[k] = p.mass[i];
+            }
+        }, 16384);
+        timings.build = since(start);
+        if (n == 0)
+            return;
+
+        start = Clock::now();
+        upward();
+        timings.upward = since(start);
+
+        start = Clock::now();
+        walk();
+        timings.walk = since(start);
+
+        start = Clock::now();
+        cellToCell(eps2);
+        timings.m2l = since(start);
+
+        start = Clock::now();
+        downward(eps2);
+        timings.downward = since(start);
+    }
+
+    // P2M at the leaves, in parallel, then M2M towards the root; children
+    // always sit after their parent in the node array
+    void upward()
+    {
+        const std::vector<OctreeNode>& nodes = tree.nodes;
+        const size_t cells = nodes.size();
+        const int count = expansion.count;
+        centre.resize(cells);
+        radius.resize(cells);
+        multipole.assign(cells * count, 0.0);
+
+        parallelFor(0, cells, [&](size_t b, size_t e)
+        {
+            std::vector<double> powers(count);
+            for (size_t c = b; c < e; c++)
+            {
+                const OctreeNode& node = nodes[c];
+                centre[c] = glm::dvec3(node.com);
+                if (node.firstChild >= 0)
+                    continue;
+                double* M = &multipole[c * count];
+                double r2 = 0.0;
+                for (unsigned int k = node.begin; k < node.end; k++)
+                {
+                    glm::dvec3 d = centre[c] - glm::dvec3(sx[k], sy[k], sz[k]);
+                    r2 = std::max(r2, glm::dot(d, d));
+                    expansion.scaledPowers(d, powers.data());
+                    for (int t = 0; t < count; t++)
+                        M[t] += sm[k] * powers[t];
+                }
+                radius[c] = std::sqrt(r2);
+            }
+        }, 256);
+
+        sortByLevel();
+        for (size_t level = levelStart.size() - 1; level-- > 0;)
+        {
+            parallelFor(levelStart[level], levelStart[level + 1], [&](size_t b, size_t e)
+            {
+                std::vector<double> powers(count);
+                for (size_t i = b; i < e; i++)
+                {
+                    const uint32_t c = byLevel[i];
+                    const OctreeNode& node = nodes[c];
+                    if (node.firstChild < 0)
+                        continue;
+                    double* M = &multipole[(size_t)c * count];
+                    // the cell's far corner bounds the radius too
+                    double r = glm::length(glm::dvec3(node.com - node.center)) + std::sqrt(3.0) * node.halfSize;
+                    double children = 0.0;
+                    for (int k = 0; k < node.childCount; k++)
+                    {
+                        const int child = node.firstChild + k;
+                        glm::dvec3 d = centre[c] - centre[child];
+                        children = std::max(children, glm::length(d) + radius[child]);
+                        expansion.scaledPowers(d, powers.data());
+                        CartesianExpansion::apply(expansion.multipoleShift, M, powers.data(), &multipole[(size_t)child * count]);
+                    }
+                    radius[c] = std::min(r, children);
+                }
+            }, 64);
+        }
+    }
+
+    // counting sort of the cells by depth; children always sit after their
+    // parent, so one forward pass finds every depth
+    void sortByLevel()
+    {
+        const std::vector<OctreeNode>& nodes = tree.nodes;
+        const size_t cells = nodes.size();
+        std::vector<uint32_t> depth(cells, 0);
+        uint32_t deepest = 0;
+        for (size_t c = 0; c < cells; c++)
+        {
+            for (int k = 0; k < nodes[c].childCount; k++)
+                depth[nodes[c].firstChild + k] = depth[c] + 1;
+            deepest = std::max(deepest, depth[c]);
+        }
+        levelStart.assign(deepest + 2, 0);
+        for (size_t c = 0; c < cells; c++)
+            levelStart[depth[c] + 1]++;
+        for (uint32_t level = 0; level <= deepest; level++)
+            levelStart[level + 1] += levelStart[level];
+        byLevel.resize(cells);
+        std::vector<uint32_t> cursor(levelStart.begin(), levelStart.end() - 1);
+        for (size_t c = 0; c < cells; c++)
+            byLevel[cursor[depth[c]]++] = (uint32_t)c;
+    }
+
+    // Mutual dual-tree walk from (root, root). The pairs are split breadth
+    // first until there are a few per thread, then each of those is walked
+    // to the bottom by its own task into private pair lists, which are
+    // joined in task order so the result doesn't depend on the scheduling.
+    void walk()
+    {
+        cellPairs.clear();
+        leafPairs.clear();
+
+        const size_t target = 8 * threadPool().size();
+        Pairs frontier(1, std::make_pair(0u, 0u)), next;
+        while (!frontier.empty() && frontier.size() < target)
+        {
+            next.clear();
+            for (const std::pair<uint32_t, uint32_t>& pr : frontier)
+                visit(pr.first, pr.second, cellPairs, leafPairs, next);
+            frontier.swap(next);
+        }
+
+        std::vector<Pairs> cellParts(frontier.size()), leafParts(frontier.size());
+        {
+            TaskGroup group(threadPool());
+            for (size_t t = 0; t < frontier.size(); t++)
+            {
+                group.run([this, t, &frontier, &cellParts, &leafParts]()
+                {
+                    Pairs stack(1, frontier[t]);
+                    while (!stack.empty())
+                    {
+                        const std::pair<uint32_t, uint32_t> pr = stack.back();
+                        stack.pop_back();
+                        visit(pr.first, pr.second, cellParts[t], leafParts[t], stack);
+                    }
+                });
+            }
+            group.wait();
+        }
+        for (size_t t = 0; t < frontier.size(); t++)
+        {
+            cellPairs.insert(cellPairs.end(), cellParts[t].begin(), cellParts[t].end());
+            leafPairs.insert(leafPairs.end(), leafParts[t].begin(), leafParts[t].end());
+        }
+
+        cellInteractions = cellPairs.size();
+        leafInteractions = leafPairs.size();
+        groupByTarget(cellPairs, cellStart, cellList);
+        groupByTarget(leafPairs, leafStart, leafList);
+    }
+
+    // One step of the walk. A cell paired with itself pairs up its children;
+    // other pairs are accepted, summed directly when both are leaves, or the
+    // larger cell is split. Pairs still to visit go to 'open'.
+    void visit(uint32_t a, uint32_t b, Pairs& cells, Pairs& leaves, Pairs& open) const
+    {
+        const std::vector<OctreeNode>& nodes = tree.nodes;
+        const OctreeNode& A = nodes[a];
+        const OctreeNode& B = nodes[b];
+
+        if (a == b)
+        {
+            if (A.firstChild < 0)
+                leaves.push_back(std::make_pair(a, a));
+            for (int i = 0; i < A.childCount; i++)
+                for (int j = i; j < A.childCount; j++)
+                    open.push_back(std::make_pair((uint32_t)(A.firstChild + i), (uint32_t)(A.firstChild + j)));
+            return;
+        }
+
+        glm::dvec3 d = centre[a] - centre[b];
+        double reach = (radius[a] + radius[b]) * (theta > 0.0f ? 1.0 / theta : 0.0);
+        // two leaves with few bodies are cheaper to sum directly than to expand
+        const bool cheap = A.firstChild < 0 && B.firstChild < 0
+            && (double)(A.end - A.begin) * (B.end - B.begin) <= directFactor * expansion.m2lCost();
+        if (theta > 0.0f && !cheap && glm::dot(d, d) > reach * reach)
+        {
+            cells.push_back(std::make_pair(a, b));
+            cells.push_back(std::make_pair(b, a));
+            return;
+        }
+
+        const bool leafA = A.firstChild < 0, leafB = B.firstChild < 0;
+        if (leafA && leafB)
+        {
+            leaves.push_back(std::make_pair(a, b));
+            leaves.push_back(std::make_pair(b, a));
+        }
+        else if (leafB || (!leafA && radius[a] >= radius[b]))
+        {
+            for (int i = 0; i < A.childCount; i++)
+                open.push_back(std::make_pair((uint32_t)(A.firstChild + i), b));
+        }
+        else
+        {
+            for (int i = 0; i < B.childCount; i++)
+                open.push_back(std::make_pair(a, (uint32_t)(B.firstChild + i)));
+        }
+    }
+
+    // counting sort of (target, source) pairs into CSR form
+    void groupByTarget(const std::vector<std::pair<uint32_t, uint32_t>>& pairs, std::vector<uint32_t>& start, std::vector<uint32_t>& list) const
+    {
+        const size_t cells = tree.nodes.size();
+        start.assign(cells + 1, 0);
+        for (const std::pair<uint32_t, uint32_t>& pr : pairs)
+            start[pr.first + 1]++;
+        for (size_t c = 0; c < cells; c++)
+            start[c + 1] += start[c];
+        list.resize(pairs.size());
+        std::vector<uint32_t> cursor(start.begin(), start.end() - 1);
+        for (const std::pair<uint32_t, uint32_t>& pr : pairs)
+            list[cursor[pr.first]++] = pr.second;
+    }
+
+    // M2L for every receiving cell
+    void cellToCell(double eps2)
+    {
+        const size_t cells = tree.nodes.size();
+        const int count = expansion.count;
+        local.assign(cells * count, 0.0);
+
+        parallelFor(0, cells, [&](size_t b, size_t e)
+        {
+            std::vector<double> D(count), work((size_t)count * (expansion.order + 1));
+            for (size_t c = b; c < e; c++)
+            {
+                double* L = &local[c * count];
+                for (uint32_t s = cellStart[c]; s < cellStart[c + 1]; s++)
+                {
+                    const uint32_t source = cellList[s];
+                    expansion.derivatives(centre[c] - centre[source], eps2, D.data(), work.data());
+                    expansion.m2l(&multipole[(size_t)source * count], D.data(), L);
+                }
+            }
+        }, 64);
+    }
+
+    // L2L towards the leaves one level at a time (each parent writes only
+    // its own children), then per leaf (in parallel) L2P plus the direct sums.
+    // A leaf's near-field bodies are gathered into one list and summed by
+    // the SIMD kernel; with softening > 0 the target's own entry adds zero.
+    void downward(double eps2)
+    {
+        const std::vector<OctreeNode>& nodes = tree.nodes;
+        const size_t cells = nodes.size();
+        const int count = expansion.count;
+
+        for (size_t level = 0; level + 1 < levelStart.size(); level++)
+        {
+            parallelFor(levelStart[level], levelStart[level + 1], [&](size_t b, size_t e)
+            {
+                std::vector<double> powers(count);
+                for (size_t i = b; i < e; i++)
+                {
+                    const uint32_t c = byLevel[i];
+                    const OctreeNode& node = nodes[c];
+                    for (int k = 0; k < node.childCount; k++)
+                    {
+                        const int child = node.firstChild + k;
+                        expansion.scaledPowers(centre[child] - centre[c], powers.data());
+                        CartesianExpansion::apply(expansion.localShift, &local[(size_t)child * count], powers.data(), &local[(size_t)c * count]);
+                    }
+                }
+            }, 64);
+        }
+
+        const GravityKernelFn kernel = gravityKernel();
+        parallelFor(0, cells, [&](size_t b, size_t e)
+        {
+            std::vector<double> P(count);
+            std::vector<float> x, y, z, m;
+            for (size_t c = b; c < e; c++)
+            {
+                const OctreeNode& node = nodes[c];
+                if (node.firstChild >= 0)
+                    continue;
+
+                x.clear();
+                y.clear();
+                z.clear();
+                m.clear();
+                for (uint32_t s = leafStart[c]; s < leafStart[c + 1]; s++)
+                {
+                    const OctreeNode& source = nodes[leafList[s]];
+                    x.insert(x.end(), sx.begin() + source.begin, sx.begin() + source.end);
+                    y.insert(y.end(), sy.begin() + source.begin, sy.begin() + source.end);
+                    z.insert(z.end(), sz.begin() + source.begin, sz.begin() + source.end);
+                    m.insert(m.end(), sm.begin() + source.begin, sm.begin() + source.end);
+                }
+                const GravitySources sources = { x.data(), y.data(), z.data(), m.data(), x.size() };
+
+                const double* L = &local[c * count];
+                for (unsigned int k = node.begin; k < node.end; k++)
+                {
+                    expansion.scaledPowers(glm::dvec3(sx[k], sy[k], sz[k]) - centre[c], P.data());
+                    double a[3] = { 0.0, 0.0, 0.0 };
+                    for (int i = 0; i < 3; i++)
+                        CartesianExpansion::apply(expansion.fieldTerms[i], a, P.data(), L);
+
+                    float near[3];
+                    kernel(sources, sx[k], sy[k], sz[k], (float)eps2, near);
+                    accX[k] = (float)a[0] + near[0];
+                    accY[k] = (float)a[1] + near[1];
+                    accZ[k] = (float)a[2] + near[2];
+                }
+            }
+        }, 64);
+    }
+};
+#endif
@@ -0,0 +1,68 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Binding point of the per-frame uniform block. Shader binds any block named
+// "FrameData" here at link time, so every program sees the same buffer.
+const GLuint FRAME_DATA_BINDING = 0;
+
+// std140 mirror of the FrameData block declared in the shaders:
+//
+//   layout (std140) uniform FrameData
+//   {
+//       mat4 view;
+//       mat4 projection;
+//       mat4 viewProjection;
+//       vec4 viewport; // xy = size in pixels, zw = 1 / size
+//       float time;
+//   };
+struct FrameData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    glm::vec4 viewport;
+    float time;
+    float padding[3]; // std140 rounds the block up to 16 bytes
+};
+
+static_assert(sizeof(FrameData) == 3 * 64 + 16 + 16, "FrameData must match the std140 layout");
+
+// Uniform buffer holding FrameData, written once per frame
+class FrameUniforms
+{
+public:
+    GLuint ubo;
+
+    FrameUniforms()
+    {
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, ubo);
+    }
+
+    ~FrameUniforms()
+    {
+        glDeleteBuffers(1, &ubo);
+    }
+
+    void update(const glm::mat4& view, const glm::mat4& projection, float width, float height, float time)
+    {
+        FrameData data;
+        data.view = view;
+        data.projection = projection;
+        data.viewProjection = projection * view;
+        data.viewport = glm::vec4(width, height, 1.0f / width, 1.0f / height);
+        data.time = time;
+        data.padding[0] = data.padding[1] = data.padding[2] = 0.0f;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
+#endif
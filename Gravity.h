@@ -0,0 +1,144 @@
+#ifndef GRAVITY_H
+#define GRAVITY_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ParticleStore.h"
+#include "GravityKernels.h"
+#include "GravityJerkKernels.h"
+#include "ThreadPool.h"
+#include "Ewald.h"
+
+// Direct summation gravity. Accelerations are returned without the factor G.
+
+// all-pairs O(N^2) into ax/ay/az, one SIMD kernel call per target, targets split over the pool
+// ------------------------------------------------------------------------
+inline void directAccelerations(ParticleStore& p, float softening)
+{
+    const float eps2 = softening * softening;
+    const GravitySources sources = { p.x.data(), p.y.data(), p.z.data(), p.mass.data(), p.size() };
+    const GravityKernelFn kernel = gravityKernel();
+
+    parallelFor(0, p.size(), [&](size_t b, size_t e)
+    {
+        for (size_t i = b; i < e; i++)
+        {
+            float acc[3];
+            kernel(sources, p.x[i], p.y[i], p.z[i], eps2, acc);
+            p.ax[i] = acc[0];
+            p.ay[i] = acc[1];
+            p.az[i] = acc[2];
+        }
+    }, 16);
+}
+
+// same, but only for the listed targets (the active set of a block step)
+// ------------------------------------------------------------------------
+inline void directAccelerations(ParticleStore& p, float softening, const std::vector<uint32_t>& targets)
+{
+    const float eps2 = softening * softening;
+    const GravitySources sources = { p.x.data(), p.y.data(), p.z.data(), p.mass.data(), p.size() };
+    const GravityKernelFn kernel = gravityKernel();
+
+    parallelFor(0, targets.size(), [&](size_t b, size_t e)
+    {
+        for (size_t k = b; k < e; k++)
+        {
+            uint32_t i = targets[k];
+            float acc[3];
+            kernel(sources, p.x[i], p.y[i], p.z[i], eps2, acc);
+            p.ax[i] = acc[0];
+            p.ay[i] = acc[1];
+            p.az[i] = acc[2];
+        }
+    }, 16);
+}
+
+// all-pairs accelerations and jerks into ax/ay/az and jx/jy/jz for the Hermite integrator
+// ------------------------------------------------------------------------
+inline void directAccelerationsJerks(ParticleStore& p, float softening)
+{
+    const float eps2 = softening * softening;
+    const GravityJerkSources sources = { p.x.data(), p.y.data(), p.z.data(),
+        p.vx.data(), p.vy.data(), p.vz.data(), p.mass.data(), p.size() };
+    const GravityJerkKernelFn kernel = gravityJerkKernel();
+
+    parallelFor(0, p.size(), [&](size_t b, size_t e)
+    {
+        for (size_t i = b; i < e; i++)
+        {
+            const float pos[3] = { p.x[i], p.y[i], p.z[i] };
+            const float vel[3] = { p.vx[i], p.vy[i], p.vz[i] };
+            float acc[3], jerk[3];
+            kernel(sources, pos, vel, eps2, acc, jerk);
+            p.ax[i] = acc[0]; p.ay[i] = acc[1]; p.az[i] = acc[2];
+            p.jx[i] = jerk[0]; p.jy[i] = jerk[1]; p.jz[i] = jerk[2];
+        }
+    }, 16);
+}
+
+// acceleration on a single body from all others, used as a reference for the tree
+// ------------------------------------------------------------------------
+inline glm::vec3 directAcceleration(const ParticleStore& p, size_t target, float softening)
+{
+    const double eps2 = (double)softening * softening;
+    const double xi = p.x[target], yi = p.y[target], zi = p.z[target];
+    double ax = 0.0, ay = 0.0, az = 0.0;
+    for (size_t j = 0; j < p.size(); j++)
+    {
+        if (j == target)
+            continue;
+        double dx = p.x[j] - xi, dy = p.y[j] - yi, dz = p.z[j] - zi;
+        double r2 = dx * dx + dy * dy + dz * dz + eps2;
+        double s = p.mass[j] / (r2 * std::sqrt(r2));
+        ax += dx * s; ay += dy * s; az += dz * s;
+    }
+    return glm::vec3((float)ax, (float)ay, (float)az);
+}
+
+// Periodic direct summation: every pair at its nearest image plus the Ewald
+// correction for all other images (see Ewald.h). Scalar, since each pair
+// needs a table lookup; it is the reference for the periodic tree.
+// ------------------------------------------------------------------------
+inline glm::vec3 periodicDirectAcceleration(const ParticleStore& p, size_t target, float softening, float boxSize,
+    const EwaldTable& table)
+{
+    const float eps2 = softening * softening;
+    const glm::vec3 pi = p.position(target);
+    glm::vec3 acc(0.0f);
+    for (size_t j = 0; j < p.size(); j++)
+    {
+        if (j == target)
+            continue;
+        glm::vec3 d = periodicDelta(p.position(j) - pi, boxSize);
+        float invR = 1.0f / std::sqrt(glm::dot(d, d) + eps2);
+        acc += p.mass[j] * (d * (invR * invR * invR) + table.acceleration(d, boxSize));
+    }
+    return acc;
+}
+
+inline void periodicDirectAccelerations(ParticleStore& p, float softening, float boxSize)
+{
+    const EwaldTable& table = ewaldTable();
+    parallelFor(0, p.size(), [&](size_t b, size_t e)
+    {
+        for (size_t i = b; i < e; i++)
+            p.setAcceleration(i, periodicDirectAcceleration(p, i, softening, boxSize, table));
+    }, 16);
+}
+
+inline void periodicDirectAccelerations(ParticleStore& p, float softening, float boxSize, const std::vector<uint32_t>& targets)
+{
+    const EwaldTable& table = ewaldTable();
+    parallelFor(0, targets.size(), [&](size_t b, size_t e)
+    {
+        for (size_t k = b; k < e; k++)
+            p.setAcceleration(targets[k], periodicDirectAcceleration(p, targets[k], softening, boxSize, table));
+    }, 16);
+}
+#endif
@@ -0,0 +1,188 @@
+#ifndef GRAVITY_JERK_KERNELS_H
+#define GRAVITY_JERK_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "GravityKernels.h"
+
+// Pairwise acceleration + jerk kernels for the Hermite integrator. With
+// r = x_j - x_i, v = v_j - v_i and r2 = |r|^2 + eps^2 each source adds
+//   a += m r / r2^(3/2)
+//   j += m (v - 3 (r.v / r2) r) / r2^(3/2)
+// Same layout and dispatch as the acceleration-only kernels; the SSE4.2
+// level uses the scalar path.
+// ------------------------------------------------------------------------
+
+struct GravityJerkSources
+{
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* vx;
+    const float* vy;
+    const float* vz;
+    const float* m;
+    size_t count;
+};
+
+// pos and vel of the target in, acc and jerk (without G) out
+typedef void (*GravityJerkKernelFn)(const GravityJerkSources& src, const float pos[3], const float vel[3], float eps2, float acc[3], float jerk[3]);
+
+inline void gravityJerkKernelScalar(const GravityJerkSources& src, const float pos[3], const float vel[3], float eps2, float acc[3], float jerk[3])
+{
+    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+    float jx = 0.0f, jy = 0.0f, jz = 0.0f;
+    for (size_t j = 0; j < src.count; j++)
+    {
+        float dx = src.x[j] - pos[0], dy = src.y[j] - pos[1], dz = src.z[j] - pos[2];
+        float dvx = src.vx[j] - vel[0], dvy = src.vy[j] - vel[1], dvz = src.vz[j] - vel[2];
+        float r2 = dx * dx + dy * dy + dz * dz + eps2;
+        float invR = 1.0f / std::sqrt(r2);
+        float invR2 = invR * invR;
+        float s = src.m[j] * invR * invR2;
+        float rv = 3.0f * (dx * dvx + dy * dvy + dz * dvz) * invR2;
+        ax += dx * s; ay += dy * s; az += dz * s;
+        jx += (dvx - rv * dx) * s;
+        jy += (dvy - rv * dy) * s;
+        jz += (dvz - rv * dz) * s;
+    }
+    acc[0] = ax; acc[1] = ay; acc[2] = az;
+    jerk[0] = jx; jerk[1] = jy; jerk[2] = jz;
+}
+
+#ifdef GALAXY_X86
+
+// 8 lanes with FMA; src holds x, y, z, vx, vy, vz, m and tgt the broadcast target
+// ------------------------------------------------------------------------
+GALAXY_TARGET("avx2,fma")
+inline void gravityJerkAccumulateAVX2(const __m256* src, const __m256* tgt, const __m256& eps, __m256* acc, __m256* jerk)
+{
+    const __m256 half = _mm256_set1_ps(0.5f), threeHalves = _mm256_set1_ps(1.5f), three = _mm256_set1_ps(3.0f);
+    __m256 dx = _mm256_sub_ps(src[0], tgt[0]);
+    __m256 dy = _mm256_sub_ps(src[1], tgt[1]);
+    __m256 dz = _mm256_sub_ps(src[2], tgt[2]);
+    __m256 dvx = _mm256_sub_ps(src[3], tgt[3]);
+    __m256 dvy = _mm256_sub_ps(src[4], tgt[4]);
+    __m256 dvz = _mm256_sub_ps(src[5], tgt[5]);
+    __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps)));
+    __m256 r = _mm256_rsqrt_ps(r2);
+    r = _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(r, r), threeHalves));
+    __m256 invR2 = _mm256_mul_ps(r, r);
+    __m256 s = _mm256_mul_ps(src[6], _mm256_mul_ps(r, invR2));
+    __m256 rv = _mm256_mul_ps(_mm256_mul_ps(three, invR2),
+        _mm256_fmadd_ps(dx, dvx, _mm256_fmadd_ps(dy, dvy, _mm256_mul_ps(dz, dvz))));
+    acc[0] = _mm256_fmadd_ps(dx, s, acc[0]);
+    acc[1] = _mm256_fmadd_ps(dy, s, acc[1]);
+    acc[2] = _mm256_fmadd_ps(dz, s, acc[2]);
+    jerk[0] = _mm256_fmadd_ps(_mm256_fnmadd_ps(rv, dx, dvx), s, jerk[0]);
+    jerk[1] = _mm256_fmadd_ps(_mm256_fnmadd_ps(rv, dy, dvy), s, jerk[1]);
+    jerk[2] = _mm256_fmadd_ps(_mm256_fnmadd_ps(rv, dz, dvz), s, jerk[2]);
+}
+
+GALAXY_TARGET("avx2,fma")
+inline void gravityJerkKernelAVX2(const GravityJerkSources& src, const float pos[3], const float vel[3], float eps2, float acc[3], float jerk[3])
+{
+    const float* columns[7] = { src.x, src.y, src.z, src.vx, src.vy, src.vz, src.m };
+    __m256 tgt[6];
+    for (int k = 0; k < 3; k++)
+    {
+        tgt[k] = _mm256_set1_ps(pos[k]);
+        tgt[k + 3] = _mm256_set1_ps(vel[k]);
+    }
+    const __m256 eps = _mm256_set1_ps(eps2);
+    __m256 a[3] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+    __m256 jk[3] = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+    __m256 s[7];
+
+    size_t j = 0;
+    for (; j + 8 <= src.count; j += 8)
+    {
+        for (int k = 0; k < 7; k++)
+            s[k] = _mm256_loadu_ps(columns[k] + j);
+        gravityJerkAccumulateAVX2(s, tgt, eps, a, jk);
+    }
+
+    if (j < src.count)
+    {
+        // masked-off lanes load mass 0 and add nothing
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(src.count - j)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for (int k = 0; k < 7; k++)
+            s[k] = _mm256_maskload_ps(columns[k] + j, mask);
+        gravityJerkAccumulateAVX2(s, tgt, eps, a, jk);
+    }
+
+    for (int k = 0; k < 3; k++)
+    {
+        acc[k] = gravityHorizontalSumAVX(a[k]);
+        jerk[k] = gravityHorizontalSumAVX(jk[k]);
+    }
+}
+
+// 16 lanes, masked tail
+// ------------------------------------------------------------------------
+GALAXY_TARGET("avx512f")
+inline void gravityJerkKernelAVX512(const GravityJerkSources& src, const float pos[3], const float vel[3], float eps2, float acc[3], float jerk[3])
+{
+    const __m512 px = _mm512_set1_ps(pos[0]), py = _mm512_set1_ps(pos[1]), pz = _mm512_set1_ps(pos[2]);
+    const __m512 pvx = _mm512_set1_ps(vel[0]), pvy = _mm512_set1_ps(vel[1]), pvz = _mm512_set1_ps(vel[2]);
+    const __m512 eps = _mm512_set1_ps(eps2);
+    const __m512 half = _mm512_set1_ps(0.5f), threeHalves = _mm512_set1_ps(1.5f), three = _mm512_set1_ps(3.0f);
+    __m512 ax = _mm512_setzero_ps(), ay = _mm512_setzero_ps(), az = _mm512_setzero_ps();
+    __m512 jx = _mm512_setzero_ps(), jy = _mm512_setzero_ps(), jz = _mm512_setzero_ps();
+
+    for (size_t j = 0; j < src.count; j += 16)
+    {
+        size_t remaining = src.count - j;
+        __mmask16 mask = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1u);
+        __m512 dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, src.x + j), px);
+        __m512 dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, src.y + j), py);
+        __m512 dz = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, src.z + j), pz);
+        __m512 dvx = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, src.vx + j), pvx);
+        __m512 dvy = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, src.vy + j), pvy);
+        __m512 dvz = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, src.vz + j), pvz);
+        __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, eps)));
+        __m512 r = _mm512_maskz_rsqrt14_ps((__mmask16)0xFFFF, r2);
+        r = _mm512_mul_ps(r, _mm512_fnmadd_ps(_mm512_mul_ps(half, r2), _mm512_mul_ps(r, r), threeHalves));
+        __m512 invR2 = _mm512_mul_ps(r, r);
+        __m512 s = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, src.m + j), _mm512_mul_ps(r, invR2));
+        __m512 rv = _mm512_mul_ps(_mm512_mul_ps(three, invR2),
+            _mm512_fmadd_ps(dx, dvx, _mm512_fmadd_ps(dy, dvy, _mm512_mul_ps(dz, dvz))));
+        ax = _mm512_fmadd_ps(dx, s, ax);
+        ay = _mm512_fmadd_ps(dy, s, ay);
+        az = _mm512_fmadd_ps(dz, s, az);
+        jx = _mm512_fmadd_ps(_mm512_fnmadd_ps(rv, dx, dvx), s, jx);
+        jy = _mm512_fmadd_ps(_mm512_fnmadd_ps(rv, dy, dvy), s, jy);
+        jz = _mm512_fmadd_ps(_mm512_fnmadd_ps(rv, dz, dvz), s, jz);
+    }
+
+    acc[0] = gravityHorizontalSumAVX512(ax);
+    acc[1] = gravityHorizontalSumAVX512(ay);
+    acc[2] = gravityHorizontalSumAVX512(az);
+    jerk[0] = gravityHorizontalSumAVX512(jx);
+    jerk[1] = gravityHorizontalSumAVX512(jy);
+    jerk[2] = gravityHorizontalSumAVX512(jz);
+}
+
+#endif
+
+// ------------------------------------------------------------------------
+inline GravityJerkKernelFn gravityJerkKernelFor(SimdIsa isa)
+{
+#ifdef GALAXY_X86
+    switch (isa)
+    {
+    case SimdIsa::AVX512: return gravityJerkKernelAVX512;
+    case SimdIsa::AVX2: return gravityJerkKernelAVX2;
+    default: break;
+    }
+#endif
+    return gravityJerkKernelScalar;
+}
+
+inline GravityJerkKernelFn gravityJerkKernel()
+{
+    static const GravityJerkKernelFn kernel = gravityJerkKernelFor(nativeSimdIsa());
+    return kernel;
+}
+#endif
@@ -0,0 +1,309 @@
+#ifndef GRAVITY_KERNELS_H
+#define GRAVITY_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GALAXY_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC lets any function use any intrinsic; GCC/Clang need the ISA enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define GALAXY_TARGET(isa)
+#else
+#define GALAXY_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+// Hand-vectorised pairwise gravity kernels. Each kernel sums the softened
+// acceleration (without G) on one target from a run of SoA sources, with the
+// j-loop spread across SIMD lanes. 1/sqrt uses the hardware estimate plus one
+// Newton-Raphson step. The softening must be > 0: a target that is also in the
+// source list then contributes exactly zero instead of a NaN.
+// ------------------------------------------------------------------------
+
+struct GravitySources
+{
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* m;
+    size_t count;
+};
+
+typedef void (*GravityKernelFn)(const GravitySources& src, float xi, float yi, float zi, float eps2, float acc[3]);
+
+enum class SimdIsa
+{
+    Scalar,
+    SSE42,
+    AVX2,
+    AVX512
+};
+
+inline const char* simdIsaName(SimdIsa isa)
+{
+    switch (isa)
+    {
+    case SimdIsa::SSE42: return "SSE4.2";
+    case SimdIsa::AVX2: return "AVX2+FMA";
+    case SimdIsa::AVX512: return "AVX-512F";
+    default: return "scalar";
+    }
+}
+
+// scalar reference path, also used on non-x86 targets
+// ------------------------------------------------------------------------
+inline void gravityKernelScalar(const GravitySources& src, float xi, float yi, float zi, float eps2, float acc[3])
+{
+    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+    for (size_t j = 0; j < src.count; j++)
+    {
+        float dx = src.x[j] - xi, dy = src.y[j] - yi, dz = src.z[j] - zi;
+        float r2 = dx * dx + dy * dy + dz * dz + eps2;
+        float invR = 1.0f / std::sqrt(r2);
+        float s = src.m[j] * invR * invR * invR;
+        ax += dx * s; ay += dy * s; az += dz * s;
+    }
+    acc[0] = ax; acc[1] = ay; acc[2] = az;
+}
+
+#ifdef GALAXY_X86
+
+// 4 lanes, scalar tail
+// ------------------------------------------------------------------------
+GALAXY_TARGET("sse4.2")
+inline void gravityKernelSSE42(const GravitySources& src, float xi, float yi, float zi, float eps2, float acc[3])
+{
+    const __m128 px = _mm_set1_ps(xi), py = _mm_set1_ps(yi), pz = _mm_set1_ps(zi);
+    const __m128 eps = _mm_set1_ps(eps2);
+    const __m128 half = _mm_set1_ps(0.5f), threeHalves = _mm_set1_ps(1.5f);
+    __m128 ax = _mm_setzero_ps(), ay = _mm_setzero_ps(), az = _mm_setzero_ps();
+
+    size_t j = 0;
+    for (; j + 4 <= src.count; j += 4)
+    {
+        __m128 dx = _mm_sub_ps(_mm_loadu_ps(src.x + j), px);
+        __m128 dy = _mm_sub_ps(_mm_loadu_ps(src.y + j), py);
+        __m128 dz = _mm_sub_ps(_mm_loadu_ps(src.z + j), pz);
+        __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+                               _mm_add_ps(_mm_mul_ps(dz, dz), eps));
+        __m128 y = _mm_rsqrt_ps(r2);
+        y = _mm_mul_ps(y, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, r2), _mm_mul_ps(y, y))));
+        __m128 s = _mm_mul_ps(_mm_loadu_ps(src.m + j), _mm_mul_ps(y, _mm_mul_ps(y, y)));
+        ax = _mm_add_ps(ax, _mm_mul_ps(dx, s));
+        ay = _mm_add_ps(ay, _mm_mul_ps(dy, s));
+        az = _mm_add_ps(az, _mm_mul_ps(dz, s));
+    }
+
+    // horizontal sums: (ax0+ax1, ax2+ax3, ay0+ay1, ay2+ay3) -> (ax, ay, az, az)
+    __m128 sum = _mm_hadd_ps(_mm_hadd_ps(ax, ay), _mm_hadd_ps(az, az));
+    float lanes[4];
+    _mm_storeu_ps(lanes, sum);
+
+    GravitySources tail = { src.x + j, src.y + j, src.z + j, src.m + j, src.count - j };
+    gravityKernelScalar(tail, xi, yi, zi, eps2, acc);
+    acc[0] += lanes[0]; acc[1] += lanes[1]; acc[2] += lanes[2];
+}
+
+// 8 lanes with FMA, masked loads for the tail
+// ------------------------------------------------------------------------
+GALAXY_TARGET("avx2,fma")
+inline float gravityHorizontalSumAVX(const __m256& v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_hadd_ps(s, s);
+    s = _mm_hadd_ps(s, s);
+    return _mm_cvtss_f32(s);
+}
+
+GALAXY_TARGET("avx2,fma")
+inline void gravityAccumulateAVX2(const __m256& x, const __m256& y, const __m256& z, const __m256& m,
+    const __m256& px, const __m256& py, const __m256& pz, const __m256& eps, __m256& ax, __m256& ay, __m256& az)
+{
+    const __m256 half = _mm256_set1_ps(0.5f), threeHalves = _mm256_set1_ps(1.5f);
+    __m256 dx = _mm256_sub_ps(x, px);
+    __m256 dy = _mm256_sub_ps(y, py);
+    __m256 dz = _mm256_sub_ps(z, pz);
+    __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps)));
+    __m256 r = _mm256_rsqrt_ps(r2);
+    r = _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(r, r), threeHalves));
+    __m256 s = _mm256_mul_ps(m, _mm256_mul_ps(r, _mm256_mul_ps(r, r)));
+    ax = _mm256_fmadd_ps(dx, s, ax);
+    ay = _mm256_fmadd_ps(dy, s, ay);
+    az = _mm256_fmadd_ps(dz, s, az);
+}
+
+GALAXY_TARGET("avx2,fma")
+inline void gravityKernelAVX2(const GravitySources& src, float xi, float yi, float zi, float eps2, float acc[3])
+{
+    const __m256 px = _mm256_set1_ps(xi), py = _mm256_set1_ps(yi), pz = _mm256_set1_ps(zi);
+    const __m256 eps = _mm256_set1_ps(eps2);
+    __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps(), az = _mm256_setzero_ps();
+
+    size_t j = 0;
+    for (; j + 8 <= src.count; j += 8)
+    {
+        gravityAccumulateAVX2(_mm256_loadu_ps(src.x + j), _mm256_loadu_ps(src.y + j), _mm256_loadu_ps(src.z + j),
+            _mm256_loadu_ps(src.m + j), px, py, pz, eps, ax, ay, az);
+    }
+
+    if (j < src.count)
+    {
+        // masked-off lanes load mass 0 and add nothing
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(src.count - j)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        gravityAccumulateAVX2(_mm256_maskload_ps(src.x + j, mask), _mm256_maskload_ps(src.y + j, mask),
+            _mm256_maskload_ps(src.z + j, mask), _mm256_maskload_ps(src.m + j, mask), px, py, pz, eps, ax, ay, az);
+    }
+
+    acc[0] = gravityHorizontalSumAVX(ax);
+    acc[1] = gravityHorizontalSumAVX(ay);
+    acc[2] = gravityHorizontalSumAVX(az);
+}
+
+// 16 lanes, 14-bit rsqrt estimate refined once, masked tail
+// ------------------------------------------------------------------------
+GALAXY_TARGET("avx512f")
+inline float gravityHorizontalSumAVX512(const __m512& v)
+{
+    const __mmask16 all = (__mmask16)0xFFFF;
+    __m512 s = _mm512_add_ps(v, _mm512_maskz_shuffle_f32x4(all, v, v, 0x4E)); // swap 256-bit halves
+    s = _mm512_add_ps(s, _mm512_maskz_shuffle_f32x4(all, s, s, 0xB1));        // swap 128-bit pairs
+    s = _mm512_add_ps(s, _mm512_maskz_permute_ps(all, s, 0x4E));
+    s = _mm512_add_ps(s, _mm512_maskz_permute_ps(all, s, 0xB1));
+    return _mm512_cvtss_f32(s);
+}
+
+GALAXY_TARGET("avx512f")
+inline void gravityKernelAVX512(const GravitySources& src, float xi, float yi, float zi, float eps2, float acc[3])
+{
+    const __m512 px = _mm512_set1_ps(xi), py = _mm512_set1_ps(yi), pz = _mm512_set1_ps(zi);
+    const __m512 eps = _mm512_set1_ps(eps2);
+    const __m512 half = _mm512_set1_ps(0.5f), threeHalves = _mm512_set1_ps(1.5f);
+    __m512 ax = _mm512_setzero_ps(), ay = _mm512_setzero_ps(), az = _mm512_setzero_ps();
+
+    for (size_t j = 0; j < src.count; j += 16)
+    {
+        size_t remaining = src.count - j;
+        __mmask16 mask = remaining >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << remaining) - 1u);
+        __m512 dx = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, src.x + j), px);
+        __m512 dy = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, src.y + j), py);
+        __m512 dz = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, src.z + j), pz);
+        __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, eps)));
+        __m512 r = _mm512_maskz_rsqrt14_ps((__mmask16)0xFFFF, r2);
+        r = _mm512_mul_ps(r, _mm512_fnmadd_ps(_mm512_mul_ps(half, r2), _mm512_mul_ps(r, r), threeHalves));
+        __m512 s = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, src.m + j), _mm512_mul_ps(r, _mm512_mul_ps(r, r)));
+        ax = _mm512_fmadd_ps(dx, s, ax);
+        ay = _mm512_fmadd_ps(dy, s, ay);
+        az = _mm512_fmadd_ps(dz, s, az);
+    }
+
+    acc[0] = gravityHorizontalSumAVX512(ax);
+    acc[1] = gravityHorizontalSumAVX512(ay);
+    acc[2] = gravityHorizontalSumAVX512(az);
+}
+
+// CPUID / XGETBV feature detection; AVX paths also need OS support for the
+// wider register state
+// ------------------------------------------------------------------------
+inline void galaxyCpuid(int leaf, int subleaf, unsigned int regs[4])
+{
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, subleaf);
+    for (int k = 0; k < 4; k++)
+        regs[k] = (unsigned int)r[k];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+inline uint64_t galaxyXgetbv()
+{
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    unsigned int lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+inline SimdIsa detectSimdIsa()
+{
+    unsigned int r[4];
+    galaxyCpuid(0, 0, r);
+    const unsigned int maxLeaf = r[0];
+
+    galaxyCpuid(1, 0, r);
+    const bool sse42 = (r[2] >> 20) & 1;
+    const bool fma = (r[2] >> 12) & 1;
+    const bool osxsave = (r[2] >> 27) & 1;
+    const bool avx = (r[2] >> 28) & 1;
+
+    bool avx2 = false, avx512 = false;
+    if (maxLeaf >= 7)
+    {
+        galaxyCpuid(7, 0, r);
+        avx2 = (r[1] >> 5) & 1;
+        avx512 = (r[1] >> 16) & 1;
+    }
+
+    const uint64_t xcr0 = osxsave ? galaxyXgetbv() : 0;
+    const bool ymmState = (xcr0 & 0x6) == 0x6;
+    const bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+    if (avx512 && zmmState)
+        return SimdIsa::AVX512;
+    if (avx && avx2 && fma && ymmState)
+        return SimdIsa::AVX2;
+    if (sse42)
+        return SimdIsa::SSE42;
+    return SimdIsa::Scalar;
+}
+
+#else
+
+inline SimdIsa detectSimdIsa()
+{
+    return SimdIsa::Scalar;
+}
+
+#endif
+
+// the kernel for a given ISA; the caller must make sure the CPU supports it
+// ------------------------------------------------------------------------
+inline GravityKernelFn gravityKernelFor(SimdIsa isa)
+{
+#ifdef GALAXY_X86
+    switch (isa)
+    {
+    case SimdIsa::AVX512: return gravityKernelAVX512;
+    case SimdIsa::AVX2: return gravityKernelAVX2;
+    case SimdIsa::SSE42: return gravityKernelSSE42;
+    default: break;
+    }
+#endif
+    return gravityKernelScalar;
+}
+
+// best ISA of the running CPU, detected once
+inline SimdIsa nativeSimdIsa()
+{
+    static const SimdIsa isa = detectSimdIsa();
+    return isa;
+}
+
+inline GravityKernelFn gravityKernel()
+{
+    static const GravityKernelFn kernel = gravityKernelFor(nativeSimdIsa());
+    return kernel;
+}
+#endif
@@ -0,0 +1,123 @@
+#ifndef GRAVITY_QUADRUPOLE_KERNELS_H
+#define GRAVITY_QUADRUPOLE_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "GravityKernels.h"
+
+// Quadrupole part of the field of a run of tree cells, for the group walk's
+// interaction lists (the monopoles go through the plain gravity kernels as
+// point masses). With d = com - target, r2 = |d|^2 + eps^2 and Q the
+// traceless quadrupole about the com each cell adds
+//   a = -Q.d / r^5 + 5/2 (d.Q.d) d / r^7
+// Same layout and dispatch as the other kernels; the SSE4.2 level uses the
+// scalar path and AVX-512 machines the AVX2 one.
+// ------------------------------------------------------------------------
+
+struct GravityQuadrupoleSources
+{
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* q[6]; // xx, xy, xz, yy, yz, zz
+    size_t count;
+};
+
+typedef void (*GravityQuadrupoleKernelFn)(const GravityQuadrupoleSources& src, float xi, float yi, float zi, float eps2, float acc[3]);
+
+inline void gravityQuadrupoleKernelScalar(const GravityQuadrupoleSources& src, float xi, float yi, float zi, float eps2, float acc[3])
+{
+    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+    for (size_t j = 0; j < src.count; j++)
+    {
+        float dx = src.x[j] - xi, dy = src.y[j] - yi, dz = src.z[j] - zi;
+        float invR = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + eps2);
+        float invR2 = invR * invR;
+        float invR5 = invR * invR2 * invR2;
+        float qx = src.q[0][j] * dx + src.q[1][j] * dy + src.q[2][j] * dz;
+        float qy = src.q[1][j] * dx + src.q[3][j] * dy + src.q[4][j] * dz;
+        float qz = src.q[2][j] * dx + src.q[4][j] * dy + src.q[5][j] * dz;
+        float s = 2.5f * (dx * qx + dy * qy + dz * qz) * invR5 * invR2;
+        ax += dx * s - qx * invR5;
+        ay += dy * s - qy * invR5;
+        az += dz * s - qz * invR5;
+    }
+    acc[0] = ax; acc[1] = ay; acc[2] = az;
+}
+
+#ifdef GALAXY_X86
+
+// 8 lanes with FMA; masked-off tail lanes load Q = 0 and add nothing
+// ------------------------------------------------------------------------
+GALAXY_TARGET("avx2,fma")
+inline void gravityQuadrupoleAccumulateAVX2(const __m256* s, const __m256& px, const __m256& py, const __m256& pz,
+    const __m256& eps, __m256& ax, __m256& ay, __m256& az)
+{
+    const __m256 half = _mm256_set1_ps(0.5f), threeHalves = _mm256_set1_ps(1.5f), fiveHalves = _mm256_set1_ps(2.5f);
+    __m256 dx = _mm256_sub_ps(s[0], px);
+    __m256 dy = _mm256_sub_ps(s[1], py);
+    __m256 dz = _mm256_sub_ps(s[2], pz);
+    __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps)));
+    __m256 r = _mm256_rsqrt_ps(r2);
+    r = _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(r, r), threeHalves));
+    __m256 invR2 = _mm256_mul_ps(r, r);
+    __m256 invR5 = _mm256_mul_ps(r, _mm256_mul_ps(invR2, invR2));
+    __m256 qx = _mm256_fmadd_ps(s[3], dx, _mm256_fmadd_ps(s[4], dy, _mm256_mul_ps(s[5], dz)));
+    __m256 qy = _mm256_fmadd_ps(s[4], dx, _mm256_fmadd_ps(s[6], dy, _mm256_mul_ps(s[7], dz)));
+    __m256 qz = _mm256_fmadd_ps(s[5], dx, _mm256_fmadd_ps(s[7], dy, _mm256_mul_ps(s[8], dz)));
+    __m256 dqd = _mm256_fmadd_ps(dx, qx, _mm256_fmadd_ps(dy, qy, _mm256_mul_ps(dz, qz)));
+    __m256 f = _mm256_mul_ps(_mm256_mul_ps(fiveHalves, dqd), _mm256_mul_ps(invR5, invR2));
+    ax = _mm256_add_ps(ax, _mm256_fmsub_ps(dx, f, _mm256_mul_ps(qx, invR5)));
+    ay = _mm256_add_ps(ay, _mm256_fmsub_ps(dy, f, _mm256_mul_ps(qy, invR5)));
+    az = _mm256_add_ps(az, _mm256_fmsub_ps(dz, f, _mm256_mul_ps(qz, invR5)));
+}
+
+GALAXY_TARGET("avx2,fma")
+inline void gravityQuadrupoleKernelAVX2(const GravityQuadrupoleSources& src, float xi, float yi, float zi, float eps2, float acc[3])
+{
+    const float* columns[9] = { src.x, src.y, src.z, src.q[0], src.q[1], src.q[2], src.q[3], src.q[4], src.q[5] };
+    const __m256 px = _mm256_set1_ps(xi), py = _mm256_set1_ps(yi), pz = _mm256_set1_ps(zi);
+    const __m256 eps = _mm256_set1_ps(eps2);
+    __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps(), az = _mm256_setzero_ps();
+    __m256 s[9];
+
+    size_t j = 0;
+    for (; j + 8 <= src.count; j += 8)
+    {
+        for (int k = 0; k < 9; k++)
+            s[k] = _mm256_loadu_ps(columns[k] + j);
+        gravityQuadrupoleAccumulateAVX2(s, px, py, pz, eps, ax, ay, az);
+    }
+
+    if (j < src.count)
+    {
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(src.count - j)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for (int k = 0; k < 9; k++)
+            s[k] = _mm256_maskload_ps(columns[k] + j, mask);
+        gravityQuadrupoleAccumulateAVX2(s, px, py, pz, eps, ax, ay, az);
+    }
+
+    acc[0] = gravityHorizontalSumAVX(ax);
+    acc[1] = gravityHorizontalSumAVX(ay);
+    acc[2] = gravityHorizontalSumAVX(az);
+}
+
+#endif
+
+// ------------------------------------------------------------------------
+inline GravityQuadrupoleKernelFn gravityQuadrupoleKernelFor(SimdIsa isa)
+{
+#ifdef GALAXY_X86
+    if (isa == SimdIsa::AVX2 || isa == SimdIsa::AVX512)
+        return gravityQuadrupoleKernelAVX2;
+#endif
+    return gravityQuadrupoleKernelScalar;
+}
+
+inline GravityQuadrupoleKernelFn gravityQuadrupoleKernel()
+{
+    static const GravityQuadrupoleKernelFn kernel = gravityQuadrupoleKernelFor(nativeSimdIsa());
+    return kernel;
+}
+#endif
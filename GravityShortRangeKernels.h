@@ -0,0 +1,283 @@
+#ifndef GRAVITY_SHORT_RANGE_KERNELS_H
+#define GRAVITY_SHORT_RANGE_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+
+#include "GravityKernels.h"
+
+// TreePM short-range kernels for the group walk's interaction lists: the
+// plain point-mass and quadrupole kernels with every term scaled by the
+// erfc screening of its source, read per pair from tables in the unsoftened
+// r^2 (linear interpolation; at and beyond the cutoff a source adds nothing).
+//
+// For the screened potential psi(r) = erfc(u) / r, u = r / (2 rs), with
+//   g = erfc(u) + 2u / sqrt(pi) exp(-u^2)   (the monopole's share)
+//   h = 4u^3 / sqrt(pi) exp(-u^2)
+// a cell's quadrupole Q (traceless, as in the Newtonian kernels) and its
+// spread S = sum m |x - com|^2 add, with d = com - target and H = h/3,
+//   a = -(g + H) Q.d / r^5 + 5/2 (g + H + 2/5 u^2 H) (d.Q.d) d / r^7 + u^2 H S d / r^5
+// which is the Newtonian quadrupole at h = 0. Only g and H are tabulated. S matters because, unlike
+// 1/r, the screened potential has a non-zero Laplacian, so the trace of the
+// second moment no longer drops out. Same dispatch as the quadrupole
+// kernels: AVX2 (gathers for the tables) on AVX2 and AVX-512 machines.
+// ------------------------------------------------------------------------
+
+struct GravityScreening
+{
+    const float* force; // g
+    const float* shape; // H = h/3
+    float scale;        // table position per unit r^2
+    float u2;           // u^2 per unit r^2, 1 / (4 rs^2)
+    int size;           // entries 0..size, the last one at the cutoff
+};
+
+struct GravityScreenedCells
+{
+    const float* x;
+    const float* y;
+    const float* z;
+    const float* q[6]; // xx, xy, xz, yy, yz, zz
+    const float* spread;
+    size_t count;
+};
+
+typedef void (*GravityShortRangeKernelFn)(const GravitySources& src, const GravityScreening& screening,
+    float xi, float yi, float zi, float eps2, float acc[3]);
+typedef void (*GravityShortRangeQuadrupoleKernelFn)(const GravityScreenedCells& src, const GravityScreening& screening,
+    float xi, float yi, float zi, float eps2, float acc[3]);
+
+// table value at r^2 = d2, 0 at and beyond the cutoff
+inline float gravityScreen(const float* table, const GravityScreening& s, float d2)
+{
+    float t = d2 * s.scale;
+    if (t >= (float)s.size)
+        return 0.0f;
+    int k = (int)t;
+    float f = t - (float)k;
+    return table[k] + f * (table[k + 1] - table[k]);
+}
+
+inline void gravityShortRangeKernelScalar(const GravitySources& src, const GravityScreening& screening,
+    float xi, float yi, float zi, float eps2, float acc[3])
+{
+    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+    for (size_t j = 0; j < src.count; j++)
+    {
+        float dx = src.x[j] - xi, dy = src.y[j] - yi, dz = src.z[j] - zi;
+        float d2 = dx * dx + dy * dy + dz * dz;
+        float g = gravityScreen(screening.force, screening, d2);
+        if (g == 0.0f)
+            continue;
+        float invR = 1.0f / std::sqrt(d2 + eps2);
+        float s = src.m[j] * invR * invR * invR * g;
+        ax += dx * s; ay += dy * s; az += dz * s;
+    }
+    acc[0] = ax; acc[1] = ay; acc[2] = az;
+}
+
+inline void gravityShortRangeQuadrupoleKernelScalar(const GravityScreenedCells& src, const GravityScreening& screening,
+    float xi, float yi, float zi, float eps2, float acc[3])
+{
+    float ax = 0.0f, ay = 0.0f, az = 0.0f;
+    for (size_t j = 0; j < src.count; j++)
+    {
+        float dx = src.x[j] - xi, dy = src.y[j] - yi, dz = src.z[j] - zi;
+        float d2 = dx * dx + dy * dy + dz * dz;
+        if (d2 * screening.scale >= (float)screening.size)
+            continue;
+        float invR = 1.0f / std::sqrt(d2 + eps2);
+        float invR2 = invR * invR;
+        float invR5 = invR * invR2 * invR2;
+        float qx = src.q[0][j] * dx + src.q[1][j] * dy + src.q[2][j] * dz;
+        float qy = src.q[1][j] * dx + src.q[3][j] * dy + src.q[4][j] * dz;
+        float qz = src.q[2][j] * dx + src.q[4][j] * dy + src.q[5][j] * dz;
+        float shape = gravityScreen(screening.shape, screening, d2);
+        float trace = d2 * screening.u2 * shape;
+        float quad = gravityScreen(screening.force, screening, d2) + shape;
+        float a = quad * invR5;
+        float s = 2.5f * (quad + 0.4f * trace) * (dx * qx + dy * qy + dz * qz) * invR5 * invR2
+            + trace * src.spread[j] * invR5;
+        ax += dx * s - qx * a;
+        ay += dy * s - qy * a;
+        az += dz * s - qz * a;
+    }
+    acc[0] = ax; acc[1] = ay; acc[2] = az;
+}
+
+#ifdef GALAXY_X86
+
+// table values for 8 lanes of t = r^2 * scale; lanes at or past the cutoff read 0.
+// The kernels below hoist the screening into range: scale, size, the largest
+// t below size, and u2.
+// ------------------------------------------------------------------------
+GALAXY_TARGET("avx2,fma")
+inline __m256 gravityScreenAVX2(const float* table, const __m256& t, const __m256& inside, const __m256& last)
+{
+    __m256 c = _mm256_min_ps(t, last);
+    __m256i k = _mm256_cvttps_epi32(c);
+    __m256 f = _mm256_sub_ps(c, _mm256_cvtepi32_ps(k));
+    __m256 a = _mm256_i32gather_ps(table, k, 4);
+    __m256 b = _mm256_i32gather_ps(table + 1, k, 4);
+    return _mm256_and_ps(inside, _mm256_fmadd_ps(f, _mm256_sub_ps(b, a), a));
+}
+
+GALAXY_TARGET("avx2,fma")
+inline void gravityShortRangeAccumulateAVX2(const __m256* s, const GravityScreening& screening, const __m256* range,
+    const __m256& px, const __m256& py, const __m256& pz, const __m256& eps, __m256& ax, __m256& ay, __m256& az)
+{
+    const __m256 half = _mm256_set1_ps(0.5f), threeHalves = _mm256_set1_ps(1.5f);
+    __m256 dx = _mm256_sub_ps(s[0], px);
+    __m256 dy = _mm256_sub_ps(s[1], py);
+    __m256 dz = _mm256_sub_ps(s[2], pz);
+    __m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+    __m256 t = _mm256_mul_ps(d2, range[0]);
+    __m256 inside = _mm256_cmp_ps(t, range[1], _CMP_LT_OQ);
+    if (_mm256_movemask_ps(inside) == 0)
+        return;
+    __m256 r2 = _mm256_add_ps(d2, eps);
+    __m256 r = _mm256_rsqrt_ps(r2);
+    r = _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(r, r), threeHalves));
+    __m256 g = gravityScreenAVX2(screening.force, t, inside, range[2]);
+    __m256 f = _mm256_mul_ps(_mm256_mul_ps(s[3], g), _mm256_mul_ps(r, _mm256_mul_ps(r, r)));
+    ax = _mm256_fmadd_ps(dx, f, ax);
+    ay = _mm256_fmadd_ps(dy, f, ay);
+    az = _mm256_fmadd_ps(dz, f, az);
+}
+
+GALAXY_TARGET("avx2,fma")
+inline void gravityShortRangeKernelAVX2(const GravitySources& src, const GravityScreening& screening,
+    float xi, float yi, float zi, float eps2, float acc[3])
+{
+    const float* columns[4] = { src.x, src.y, src.z, src.m };
+    const __m256 px = _mm256_set1_ps(xi), py = _mm256_set1_ps(yi), pz = _mm256_set1_ps(zi);
+    const __m256 eps = _mm256_set1_ps(eps2);
+    const __m256 range[4] = { _mm256_set1_ps(screening.scale), _mm256_set1_ps((float)screening.size),
+        _mm256_set1_ps(std::nextafter((float)screening.size, 0.0f)), _mm256_set1_ps(screening.u2) };
+    __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps(), az = _mm256_setzero_ps();
+    __m256 s[4];
+
+    size_t j = 0;
+    for (; j + 8 <= src.count; j += 8)
+    {
+        for (int k = 0; k < 4; k++)
+            s[k] = _mm256_loadu_ps(columns[k] + j);
+        gravityShortRangeAccumulateAVX2(s, screening, range, px, py, pz, eps, ax, ay, az);
+    }
+
+    if (j < src.count)
+    {
+        // masked-off lanes load m = 0
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(src.count - j)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for (int k = 0; k < 4; k++)
+            s[k] = _mm256_maskload_ps(columns[k] + j, mask);
+        gravityShortRangeAccumulateAVX2(s, screening, range, px, py, pz, eps, ax, ay, az);
+    }
+
+    acc[0] = gravityHorizontalSumAVX(ax);
+    acc[1] = gravityHorizontalSumAVX(ay);
+    acc[2] = gravityHorizontalSumAVX(az);
+}
+
+GALAXY_TARGET("avx2,fma")
+inline void gravityShortRangeQuadrupoleAccumulateAVX2(const __m256* s, const GravityScreening& screening, const __m256* range,
+    const __m256& px, const __m256& py, const __m256& pz, const __m256& eps, __m256& ax, __m256& ay, __m256& az)
+{
+    const __m256 half = _mm256_set1_ps(0.5f), threeHalves = _mm256_set1_ps(1.5f), fiveHalves = _mm256_set1_ps(2.5f);
+    __m256 dx = _mm256_sub_ps(s[0], px);
+    __m256 dy = _mm256_sub_ps(s[1], py);
+    __m256 dz = _mm256_sub_ps(s[2], pz);
+    __m256 d2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dz, dz)));
+    __m256 t = _mm256_mul_ps(d2, range[0]);
+    __m256 inside = _mm256_cmp_ps(t, range[1], _CMP_LT_OQ);
+    if (_mm256_movemask_ps(inside) == 0)
+        return;
+    __m256 r2 = _mm256_add_ps(d2, eps);
+    __m256 r = _mm256_rsqrt_ps(r2);
+    r = _mm256_mul_ps(r, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(r, r), threeHalves));
+    __m256 invR2 = _mm256_mul_ps(r, r);
+    __m256 invR5 = _mm256_mul_ps(r, _mm256_mul_ps(invR2, invR2));
+    __m256 qx = _mm256_fmadd_ps(s[3], dx, _mm256_fmadd_ps(s[4], dy, _mm256_mul_ps(s[5], dz)));
+    __m256 qy = _mm256_fmadd_ps(s[4], dx, _mm256_fmadd_ps(s[6], dy, _mm256_mul_ps(s[7], dz)));
+    __m256 qz = _mm256_fmadd_ps(s[5], dx, _mm256_fmadd_ps(s[7], dy, _mm256_mul_ps(s[8], dz)));
+    __m256 dqd = _mm256_fmadd_ps(dx, qx, _mm256_fmadd_ps(dy, qy, _mm256_mul_ps(dz, qz)));
+
+    __m256 shape = gravityScreenAVX2(screening.shape, t, inside, range[2]);
+    __m256 trace = _mm256_mul_ps(_mm256_mul_ps(d2, range[3]), shape);
+    __m256 quad = _mm256_add_ps(gravityScreenAVX2(screening.force, t, inside, range[2]), shape);
+    __m256 a = _mm256_mul_ps(quad, invR5);
+    __m256 radial = _mm256_mul_ps(_mm256_mul_ps(fiveHalves, _mm256_fmadd_ps(_mm256_set1_ps(0.4f), trace, quad)),
+        _mm256_mul_ps(dqd, _mm256_mul_ps(invR5, invR2)));
+    __m256 f = _mm256_fmadd_ps(_mm256_mul_ps(trace, s[9]), invR5, radial);
+    ax = _mm256_add_ps(ax, _mm256_fmsub_ps(dx, f, _mm256_mul_ps(qx, a)));
+    ay = _mm256_add_ps(ay, _mm256_fmsub_ps(dy, f, _mm256_mul_ps(qy, a)));
+    az = _mm256_add_ps(az, _mm256_fmsub_ps(dz, f, _mm256_mul_ps(qz, a)));
+}
+
+GALAXY_TARGET("avx2,fma")
+inline void gravityShortRangeQuadrupoleKernelAVX2(const GravityScreenedCells& src, const GravityScreening& screening,
+    float xi, float yi, float zi, float eps2, float acc[3])
+{
+    const float* columns[10] = { src.x, src.y, src.z, src.q[0], src.q[1], src.q[2], src.q[3], src.q[4], src.q[5], src.spread };
+    const __m256 px = _mm256_set1_ps(xi), py = _mm256_set1_ps(yi), pz = _mm256_set1_ps(zi);
+    const __m256 eps = _mm256_set1_ps(eps2);
+    const __m256 range[4] = { _mm256_set1_ps(screening.scale), _mm256_set1_ps((float)screening.size),
+        _mm256_set1_ps(std::nextafter((float)screening.size, 0.0f)), _mm256_set1_ps(screening.u2) };
+    __m256 ax = _mm256_setzero_ps(), ay = _mm256_setzero_ps(), az = _mm256_setzero_ps();
+    __m256 s[10];
+
+    size_t j = 0;
+    for (; j + 8 <= src.count; j += 8)
+    {
+        for (int k = 0; k < 10; k++)
+            s[k] = _mm256_loadu_ps(columns[k] + j);
+        gravityShortRangeQuadrupoleAccumulateAVX2(s, screening, range, px, py, pz, eps, ax, ay, az);
+    }
+
+    if (j < src.count)
+    {
+        // masked-off lanes load Q = S = 0
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(src.count - j)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        for (int k = 0; k < 10; k++)
+            s[k] = _mm256_maskload_ps(columns[k] + j, mask);
+        gravityShortRangeQuadrupoleAccumulateAVX2(s, screening, range, px, py, pz, eps, ax, ay, az);
+    }
+
+    acc[0] = gravityHorizontalSumAVX(ax);
+    acc[1] = gravityHorizontalSumAVX(ay);
+    acc[2] = gravityHorizontalSumAVX(az);
+}
+
+#endif
+
+// ------------------------------------------------------------------------
+inline GravityShortRangeKernelFn gravityShortRangeKernelFor(SimdIsa isa)
+{
+#ifdef GALAXY_X86
+    if (isa == SimdIsa::AVX2 || isa == SimdIsa::AVX512)
+        return gravityShortRangeKernelAVX2;
+#endif
+    return gravityShortRangeKernelScalar;
+}
+
+inline GravityShortRangeQuadrupoleKernelFn gravityShortRangeQuadrupoleKernelFor(SimdIsa isa)
+{
+#ifdef GALAXY_X86
+    if (isa == SimdIsa::AVX2 || isa == SimdIsa::AVX512)
+        return gravityShortRangeQuadrupoleKernelAVX2;
+#endif
+    return gravityShortRangeQuadrupoleKernelScalar;
+}
+
+inline GravityShortRangeKernelFn gravityShortRangeKernel()
+{
+    static const GravityShortRangeKernelFn kernel = gravityShortRangeKernelFor(nativeSimdIsa());
+    return kernel;
+}
+
+inline GravityShortRangeQuadrupoleKernelFn gravityShortRangeQuadrupoleKernel()
+{
+    static const GravityShortRangeQuadrupoleKernelFn kernel = gravityShortRangeQuadrupoleKernelFor(nativeSimdIsa());
+    return kernel;
+}
+#endif
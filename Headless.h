@@ -0,0 +1,447 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <algorithm>
+#include <vector>
+
+#include "Simulation.h"
+#include "InitialConditions.h"
+
+// Headless runs: step the simulation with no window or GL context, writing
+// snapshots and per-step timing. Reached with "--headless [options]", or as
+// the only mode when Main.cpp is compiled with GALAXY_HEADLESS.
+//   --count n                    number of bodies (default 2000)
+//   --steps k                    number of steps to run (default 1000)
+//   --solver direct|tree|pm|treepm|fmm  force solver
+//   --theta t                    Barnes-Hut opening angle (also the TreePM tree and the FMM acceptance ratio)
+//   --dt t                       fixed timestep (default 0.01, --ic box: 0.001 L^1.5, see createPeriodicBox)
+//   --seed s                     initial conditions seed
+//   --snapshot-every k           write a snapshot every k steps, 0 = only the last one
+//   --out prefix                 snapshot and timing file prefix (default "snapshot")
+//   --energy                     log total energy with every snapshot, O(N^2)
+//   --threads n                  thread pool size, 0 = one per hardware thread (default)
+//   --pin                        pin pool workers to cores
+//   --reorder k                  Morton reorder interval in steps, 0 = never (default 32)
+//   --integrator leapfrog|hermite  Hermite always uses direct summation
+//   --ic disk|plummer|box|pancake  initial conditions: the rotating disk, a Plummer sphere (N-body units),
+//                                a cold uniform periodic box (direct or tree solver, leapfrog) or a
+//                                Zel'dovich pancake in an expanding box (comoving, planes cross at a = 1)
+//   --box L                      periodic box side for --ic box and pancake (default 1)
+//   --comoving a                 comoving integration of the periodic box from scale factor a; dt is then
+//                                the step in ln(a) and H0 follows from G and the mean density
+//   --omega-m m, --omega-l l     matter and vacuum density parameters of a comoving run (default 1, 0)
+//   --ic gas|evrard              SPH gas: a periodic box with random velocities (leapfrog, direct or
+//                                tree gravity) or the Evrard collapse of a cold sphere (any solver)
+//   --mach m                     rms Mach number of the --ic gas velocities (default 1)
+//   --gamma g, --viscosity a     SPH adiabatic index (default 5/3) and viscosity alpha (default 1)
+//   --no-gravity                 hydrodynamics only
+//   --ewald-cache path           Ewald table cache file, "" = never touch the disk (default ewald_table.bin)
+//   --softening e                Plummer softening length, > 0 (default 0.05, a box: 1/30 of the mean spacing)
+//   --block                      hierarchical block timesteps, dt is then the largest step
+//   --max-level L                finest block step is dt / 2^L (default 8)
+//   --grid n                     particle-mesh cells per side, a power of two (default 128, TreePM 64)
+//   --split s                    TreePM split scale rs in mesh cells (default 1.25)
+//   --order p                    FMM expansion order, 1..8 (default 4)
+//   --refit [g]                  refit the tree between rebuilds, rebuild when node volume grows g times (default 1.5)
+//   --group g                    Barnes-Hut bucket size for the group walk, 0 = one body at a time (default 32)
+//   --tolerance a                Barnes-Hut relative opening criterion, error below a |a_old|; 0 = theta (default)
+// ------------------------------------------------------------------------
+
+struct HeadlessOptions
+{
+    size_t count = 2000;
+    unsigned long long steps = 1000;
+    ForceSolver solver = ForceSolver::Direct;
+    float theta = 0.5f;
+    float timeStep = 0.01f;
+    bool timeStepGiven = false;
+    unsigned int seed = 42;
+    unsigned long long snapshotEvery = 0;
+    std::string out = "snapshot";
+    bool energy = false;
+    unsigned int threads = 0;
+    bool pin = false;
+    unsigned int reorderInterval = 32;
+    bool blockTimesteps = false;
+    int maxLevel = 8;
+    Integrator integrator = Integrator::Leapfrog;
+    bool plummer = false;
+    bool periodicBox = false;
+    bool pancake = false;
+    bool gasBox = false;
+    bool evrard = false;
+    float mach = 1.0f;
+    float gamma = 5.0f / 3.0f;
+    float viscosity = 1.0f;
+    bool gravity = true;
+    float boxSize = 1.0f;
+    bool comoving = false;
+    double scaleFactor = 1.0;
+    double omegaMatter = 1.0;
+    double omegaLambda = 0.0;
+    float softening = 0.05f;
+    bool softeningGiven = false;
+    int gridSize = 0;       // 0 = the solver's default
+    float splitCells = 1.25f;
+    int order = 4;
+    float refitGrowth = 0.0f; // 0 = rebuild every step
+    unsigned int groupSize = 32;
+    float errorTolerance = 0.0f;
+};
+
+// Binary snapshot: a small header followed by whole columns, so a reader can
+// map the positions straight into numpy or back into a ParticleStore.
+//   char[4] "GSNP", uint32 version, uint64 count, uint64 step, double time,
+//   then float x, y, z, vx, vy, vz, mass columns and a uint32 id column;
+//   version 2 appends a uint8 gas column and float smoothing, density and
+//   energy columns (zero for stars)
+// ------------------------------------------------------------------------
+inline bool writeSnapshot(const std::string& path, const Simulation& sim)
+{
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::HEADLESS::SNAPSHOT_NOT_WRITABLE: " << path << std::endl;
+        return false;
+    }
+
+    const ParticleStore& p = sim.particles;
+    const uint32_t version = 2;
+    const uint64_t count = p.size(), step = sim.stepCount;
+    file.write("GSNP", 4);
+    file.write((const char*)&version, sizeof(version));
+    file.write((const char*)&count, sizeof(count));
+    file.write((const char*)&step, sizeof(step));
+    file.write((const char*)&sim.time, sizeof(sim.time));
+
+    const AlignedVector<float>* columns[] = { &p.x, &p.y, &p.z, &p.vx, &p.vy, &p.vz, &p.mass };
+    for (const AlignedVector<float>* column : columns)
+        file.write((const char*)column->data(), column->size() * sizeof(float));
+    file.write((const char*)p.id.data(), p.id.size() * sizeof(uint32_t));
+    file.write((const char*)p.gas.data(), p.gas.size());
+    const AlignedVector<float>* gasColumns[] = { &p.smoothing, &p.density, &p.energy };
+    for (const AlignedVector<float>* column : gasColumns)
+        file.write((const char*)column->data(), column->size() * sizeof(float));
+    return (bool)file;
+}
+
+inline std::string snapshotPath(const std::string& prefix, unsigned long long step)
+{
+    char number[32];
+    std::snprintf(number, sizeof(number), "_%06llu.bin", step);
+    return prefix + number;
+}
+
+inline int runHeadless(int argc, char* argv[])
+{
+    HeadlessOptions options;
+    for (int i = 0; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--count" && hasValue)
+            options.count = (size_t)std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--steps" && hasValue)
+            options.steps = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--solver" && hasValue)
+            options.solver = parseForceSolver(argv[++i]);
+        else if (arg == "--theta" && hasValue)
+            options.theta = (float)std::atof(argv[++i]);
+        else if (arg == "--dt" && hasValue)
+        {
+            options.timeStep = (float)std::atof(argv[++i]);
+            options.timeStepGiven = true;
+        }
+        else if (arg == "--seed" && hasValue)
+            options.seed = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--snapshot-every" && hasValue)
+            options.snapshotEvery = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--out" && hasValue)
+            options.out = argv[++i];
+        else if (arg == "--energy")
+            options.energy = true;
+        else if (arg == "--threads" && hasValue)
+            options.threads = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--pin")
+            options.pin = true;
+        else if (arg == "--reorder" && hasValue)
+            options.reorderInterval = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--integrator" && hasValue)
+            options.integrator = std::string(argv[++i]) == "hermite" ? Integrator::Hermite : Integrator::Leapfrog;
+        else if (arg == "--ic" && hasValue)
+        {
+            std::string ic = argv[++i];
+            options.plummer = ic == "plummer";
+            options.periodicBox = ic == "box" || ic == "pancake" || ic == "gas";
+            options.pancake = ic == "pancake";
+            options.gasBox = ic == "gas";
+            options.evrard = ic == "evrard";
+        }
+        else if (arg == "--box" && hasValue)
+            options.boxSize = std::max((float)std::atof(argv[++i]), 1e-6f);
+        else if (arg == "--comoving" && hasValue)
+        {
+            options.comoving = true;
+            options.scaleFactor = std::max(std::atof(argv[++i]), 1e-6);
+        }
+        else if (arg == "--omega-m" && hasValue)
+            options.omegaMatter = std::max(std::atof(argv[++i]), 1e-6);
+        else if (arg == "--omega-l" && hasValue)
+            options.omegaLambda = std::atof(argv[++i]);
+        else if (arg == "--mach" && hasValue)
+            options.mach = std::max((float)std::atof(argv[++i]), 0.0f);
+        else if (arg == "--gamma" && hasValue)
+            options.gamma = std::max((float)std::atof(argv[++i]), 1.001f);
+        else if (arg == "--viscosity" && hasValue)
+            options.viscosity = std::max((float)std::atof(argv[++i]), 0.0f);
+        else if (arg == "--no-gravity")
+            options.gravity = false;
+        else if (arg == "--ewald-cache" && hasValue)
+            ewaldCachePath() = argv[++i];
+        else if (arg == "--softening" && hasValue)
+        {
+            options.softening = (float)std::atof(argv[++i]);
+            options.softeningGiven = true;
+        }
+        else if (arg == "--block")
+            options.blockTimesteps = true;
+        else if (arg == "--max-level" && hasValue)
+            options.maxLevel = std::min(std::max(std::atoi(argv[++i]), 0), 20);
+        else if (arg == "--grid" && hasValue)
+            options.gridSize = ParticleMesh::roundGridSize(std::atoi(argv[++i]));
+        else if (arg == "--split" && hasValue)
+            options.splitCells = std::max((float)std::atof(argv[++i]), 0.25f);
+        else if (arg == "--order" && hasValue)
+            options.order = std::min(std::max(std::atoi(argv[++i]), 1), 8);
+        else if (arg == "--refit")
+        {
+            options.refitGrowth = 1.5f;
+            if (hasValue && std::isdigit((unsigned char)argv[i + 1][0]))
+                options.refitGrowth = std::max((float)std::atof(argv[++i]), 1.0f);
+        }
+        else if (arg == "--group" && hasValue)
+            options.groupSize = (unsigned int)std::strtoul(argv[++i], nullptr, 10);
+        else if (arg == "--tolerance" && hasValue)
+            options.errorTolerance = std::max((float)std::atof(argv[++i]), 0.0f);
+        else
+        {
+            std::cout << "Unknown headless option: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    if (options.softeningGiven && !(options.softening > 0.0f))
+    {
+        std::cout << "ERROR::HEADLESS::SOFTENING: the softening length must be positive" << std::endl;
+        return 1;
+    }
+
+    if (options.periodicBox && (options.integrator == Integrator::Hermite
+        || (options.solver != ForceSolver::Direct && options.solver != ForceSolver::BarnesHut)))
+    {
+        std::cout << "ERROR::HEADLESS::PERIODIC_SOLVER: periodic boxes need the direct or tree solver and the leapfrog" << std::endl;
+        return 1;
+    }
+
+    if ((options.gasBox || options.evrard) && (options.comoving || options.blockTimesteps
+        || options.integrator == Integrator::Hermite))
+    {
+        std::cout << "ERROR::HEADLESS::GAS_INTEGRATOR: SPH gas needs the global leapfrog in static coordinates" << std::endl;
+        return 1;
+    }
+    if (options.comoving && !options.periodicBox)
+    {
+        std::cout << "ERROR::HEADLESS::COMOVING_BOX: comoving integration needs a periodic box (--ic box or pancake)" << std::endl;
+        return 1;
+    }
+    if ((options.comoving || options.pancake) && options.blockTimesteps)
+    {
+        std::cout << "ERROR::HEADLESS::COMOVING_BLOCK: comoving runs take global log(a) steps" << std::endl;
+        return 1;
+    }
+
+    if (options.threads != 0 || options.pin)
+        configureThreadPool(options.threads, options.pin);
+
+    Simulation sim(options.timeStep, options.softening);
+    sim.solver = options.solver;
+    sim.tree.theta = options.theta;
+    sim.reorderInterval = options.reorderInterval;
+    sim.blockTimesteps = options.blockTimesteps;
+    sim.maxLevel = options.maxLevel;
+    sim.integrator = options.integrator;
+    sim.treePM.tree.theta = options.theta;
+    sim.treePM.splitCells = options.splitCells;
+    sim.fmm.theta = options.theta;
+    sim.fmm.order = options.order;
+    sim.tree.refit = sim.treePM.tree.refit = options.refitGrowth > 0.0f;
+    sim.tree.refitGrowth = sim.treePM.tree.refitGrowth = options.refitGrowth;
+    sim.tree.groupSize = options.groupSize;
+    sim.tree.errorTolerance = options.errorTolerance;
+    sim.sph.gamma = options.gamma;
+    sim.sph.viscosity = options.viscosity;
+    sim.gravity = options.gravity;
+    if (options.gridSize > 0)
+    {
+        sim.mesh.gridSize = options.gridSize;
+        sim.treePM.mesh.gridSize = options.gridSize;
+    }
+    if (options.gasBox)
+    {
+        createGasBox(sim, options.count, options.boxSize, 1.0f, 1.0f, options.mach, options.seed);
+        if (options.softeningGiven)
+            sim.softening = options.softening;
+    }
+    else if (options.evrard)
+    {
+        createEvrardSphere(sim, options.count, 1.0f, 1.0f, options.seed);
+        if (options.softeningGiven)
+            sim.softening = options.softening;
+    }
+    else if (options.pancake)
+    {
+        int side = std::max((int)std::lround(std::cbrt((double)options.count)), 2);
+        createZeldovichPancake(sim, side, side, options.comoving ? options.scaleFactor : 0.1, 1.0, options.boxSize);
+        if (options.softeningGiven)
+            sim.softening = options.softening;
+    }
+    else if (options.periodicBox)
+    {
+        createPeriodicBox(sim, options.count, options.boxSize, 1.0f, options.seed);
+        if (options.softeningGiven)
+            sim.softening = options.softening;
+        // a comoving dt is a step in ln(a), not a time
+        if (options.timeStepGiven || options.comoving)
+            sim.timeStep = options.timeStep;
+        if (options.comoving)
+        {
+            sim.comoving = true;
+            sim.scaleFactor = options.scaleFactor;
+        }
+    }
+    else if (options.plummer)
+        createPlummerSphere(sim, options.count, 1.0f, 3.0f * glm::pi<float>() / 16.0f, options.seed);
+    else
+        createDiskGalaxy(sim, options.count, 20.0f, 1000.0f, 5000.0f, options.seed);
+    if (sim.comoving)
+    {
+        sim.cosmology.omegaMatter = options.omegaMatter;
+        sim.cosmology.omegaLambda = options.omegaLambda;
+        double mass = 0.0;
+        for (float m : sim.particles.mass)
+            mass += m;
+        sim.cosmology.hubble = Cosmology::hubbleFor(sim.G, mass / std::pow((double)sim.boxSize, 3.0), options.omegaMatter);
+    }
+
+    // report the scheme step() runs, not the one asked for
+    std::cout << "Headless run: " << sim.size() << " bodies, " << options.steps << " steps, "
+        << (sim.runsHermite() ? "Hermite, direct summation" : forceSolverName(options.solver))
+        << ", dt " << sim.timeStep << ", " << threadPool().size() << " threads"
+        << (sim.runsBlockSteps() ? ", block timesteps to level " + std::to_string(options.maxLevel) : "") << std::endl;
+    if (sim.gasCount() > 0)
+        std::cout << "SPH gas: " << sim.gasCount() << " bodies, gamma " << sim.sph.gamma << ", viscosity alpha "
+            << sim.sph.viscosity << (sim.gravity ? "" : ", no gravity") << std::endl;
+    if (sim.comoving)
+        std::cout << "Comoving from a = " << sim.scaleFactor << ", H0 " << sim.cosmology.hubble << ", Omega_m "
+            << sim.cosmology.omegaMatter << ", Omega_L " << sim.cosmology.omegaLambda << ", dt is dln(a)" << std::endl;
+    // without gravity there are no images to sum, so leave the table alone
+    if (sim.boxSize > 0.0f && !sim.gravity)
+        std::cout << "Periodic box " << sim.boxSize << ", no Ewald table" << std::endl;
+    else if (sim.boxSize > 0.0f)
+    {
+        const EwaldTable& table = ewaldTable();
+        std::cout << "Periodic box " << sim.boxSize << ", Ewald table " << (table.fromCache ? "mapped from " : "computed")
+            << (table.fromCache ? table.cachePath : table.cacheWritten ? " and cached to " + table.cachePath : " (not cached)")
+            << " in " << std::fixed << std::setprecision(3) << table.seconds << " s" << std::defaultfloat << std::endl;
+    }
+
+    std::ofstream timing(options.out + "_timing.csv");
+    if (!timing)
+    {
+        std::cout << "ERROR::HEADLESS::TIMING_NOT_WRITABLE: " << options.out << "_timing.csv" << std::endl;
+        return 1;
+    }
+    timing << "step,time,step_ms,force_evaluations,active_fraction,work_fraction,evaluations_per_body,scale_factor\n";
+
+    const double e0 = options.energy ? sim.kineticEnergy() + sim.thermalEnergy() + sim.potentialEnergy() : 0.0;
+    auto snapshot = [&]()
+    {
+        std::string path = snapshotPath(options.out, sim.stepCount);
+        if (!writeSnapshot(path, sim))
+            return false;
+        std::cout << "step " << std::setw(8) << sim.stepCount << "  t " << std::fixed << std::setprecision(3) << sim.time;
+        if (sim.comoving)
+            std::cout << "  a " << std::setprecision(4) << sim.scaleFactor;
+        std::cout << std::defaultfloat << "  -> " << path;
+        if (options.energy)
+        {
+            double e = sim.kineticEnergy() + sim.thermalEnergy() + sim.potentialEnergy();
+            std::cout << "  E " << std::setprecision(8) << e << "  dE/E " << std::setprecision(3) << (e - e0) / std::abs(e0);
+        }
+        std::cout << std::defaultfloat << std::setprecision(6) << std::endl;
+        return true;
+    };
+
+    if (!snapshot())
+        return 1;
+
+    double total = 0.0, fastest = 1e30, slowest = 0.0, work = 0.0, evaluations = 0.0;
+    for (unsigned long long s = 0; s < options.steps; s++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        sim.step();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        total += seconds;
+        fastest = std::min(fastest, seconds);
+        slowest = std::max(slowest, seconds);
+        work += sim.workFraction;
+        evaluations += sim.evaluationsPerBody;
+        timing << sim.stepCount << ',' << sim.time << ',' << seconds * 1000.0 << ','
+            << sim.forceEvaluations << ',' << sim.activeFraction << ',' << sim.workFraction << ',' << sim.evaluationsPerBody << ','
+            << (sim.comoving ? sim.scaleFactor : 1.0) << '\n';
+
+        bool last = s + 1 == options.steps;
+        if ((options.snapshotEvery > 0 && sim.stepCount % options.snapshotEvery == 0) || last)
+        {
+            if (!snapshot())
+                return 1;
+        }
+    }
+
+    if (options.steps > 0)
+    {
+        double mean = total / options.steps;
+        std::cout << std::fixed << std::setprecision(3)
+            << "ms/step: mean " << mean * 1000.0 << "  min " << fastest * 1000.0 << "  max " << slowest * 1000.0
+            << std::scientific << "   " << sim.size() / mean << " bodies/s"
+            << std::defaultfloat << std::endl;
+        if (sim.runsBlockSteps())
+            std::cout << "block timesteps: mean work fraction " << std::setprecision(3) << work / options.steps
+                << " of everyone on the finest level used, " << evaluations / options.steps
+                << " force evaluations per body and step (global steps: 1)" << std::setprecision(6) << std::endl;
+        const Octree& tree = options.solver == ForceSolver::TreePM ? sim.treePM.tree : sim.tree;
+        if (tree.rebuilds > 0 && !sim.runsHermite())
+            std::cout << std::fixed << std::setprecision(3) << "tree: " << tree.rebuilds << " rebuilds ("
+                << tree.buildSeconds * 1000.0 << " ms), " << tree.refits << " refits (" << tree.refitSeconds * 1000.0
+                << " ms)" << std::defaultfloat << std::setprecision(6) << std::endl;
+        if (sim.gasCount() > 0)
+            std::cout << std::fixed << std::setprecision(3) << "sph (last step): cell list " << sim.sph.buildSeconds * 1000.0
+                << " ms, density " << sim.sph.densitySeconds * 1000.0 << " ms, forces " << sim.sph.forceSeconds * 1000.0
+                << " ms, " << std::setprecision(1) << sim.sph.meanNeighbours << " neighbours, Courant step "
+                << std::defaultfloat << std::setprecision(3) << sim.sph.courantStep
+                << (sim.sph.courantStep < sim.timeStep ? " (below dt)" : "") << std::setprecision(6) << std::endl;
+    }
+    std::cout << "Timing written to " << options.out << "_timing.csv" << std::endl;
+    return 0;
+}
+#endif
@@ -0,0 +1,251 @@
+#ifndef INITIAL_CONDITIONS_H
+#define INITIAL_CONDITIONS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <random>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "Simulation.h"
+
+// Rotating exponential disk around a heavy central body, in the XY plane.
+// Stars start on circular orbits set by the mass enclosed within their radius.
+// ------------------------------------------------------------------------
+inline void createDiskGalaxy(Simulation& sim, size_t count, float scaleRadius = 20.0f,
+    float diskMass = 1000.0f, float centralMass = 5000.0f, unsigned int seed = 42)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    const float maxRadius = 6.0f * scaleRadius;
+    const float starMass = count > 1 ? diskMass / (count - 1) : 0.0f;
+    const float thickness = 0.05f * scaleRadius;
+
+    sim.clear();
+    sim.addBody(glm::vec3(0.0f), glm::vec3(0.0f), centralMass);
+
+    for (size_t i = 1; i < count; i++)
+    {
+        // surface density ~ exp(-r/Rd) gives a radial pdf ~ r exp(-r/Rd), i.e. Gamma(2, Rd)
+        float r;
+        do
+        {
+            r = -scaleRadius * std::log((1.0f - uniform(rng)) * (1.0f - uniform(rng)));
+        } while (r > maxRadius || r < 0.1f * scaleRadius);
+
+        float phi = 2.0f * glm::pi<float>() * uniform(rng);
+        float z = thickness * normal(rng);
+
+        // disk mass inside r, treating the disk as spherical for the orbit estimate
+        float x = r / scaleRadius;
+        float enclosed = centralMass + diskMass * (1.0f - (1.0f + x) * std::exp(-x));
+
+        float r2 = r * r + sim.softening * sim.softening;
+        float speed = std::sqrt(sim.G * enclosed * r * r / (r2 * std::sqrt(r2)));
+
+        glm::vec3 pos(r * std::cos(phi), r * std::sin(phi), z);
+        glm::vec3 vel(-speed * std::sin(phi), speed * std::cos(phi), 0.0f);
+        sim.addBody(pos, vel, starMass);
+    }
+}
+
+// isotropic direction scaled to length r
+inline glm::vec3 randomDirection(std::mt19937& rng, float r)
+{
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    float cosTheta = 2.0f * uniform(rng) - 1.0f;
+    float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    float phi = 2.0f * glm::pi<float>() * uniform(rng);
+    return r * glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+// Equal-mass Plummer sphere in virial equilibrium (Aarseth, Henon & Wielen
+// 1974), truncated at 10 scale radii and moved to the centre-of-mass frame.
+// The default scale radius 3pi/16 gives standard N-body units (G = M = 1,
+// E = -1/4) when G is 1.
+// ------------------------------------------------------------------------
+inline void createPlummerSphere(Simulation& sim, size_t count, float totalMass = 1.0f,
+    float scaleRadius = 3.0f * glm::pi<float>() / 16.0f, unsigned int seed = 42)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    const float m = count > 0 ? totalMass / count : 0.0f;
+    const float velocityScale = std::sqrt(sim.G * totalMass / scaleRadius);
+
+    sim.clear();
+    glm::dvec3 comPos(0.0), comVel(0.0);
+    std::vector<glm::vec3> pos(count), vel(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        // invert the cumulative mass M(r) = r^3 / (1 + r^2)^(3/2)
+        float r;
+        do
+        {
+            r = 1.0f / std::sqrt(std::pow(std::max(uniform(rng), 1e-10f), -2.0f / 3.0f) - 1.0f);
+        } while (r > 10.0f);
+
+        // speed as a fraction q of the local escape speed, rejection sampled from q^2 (1 - q^2)^(7/2)
+        float q, g;
+        do
+        {
+            q = uniform(rng);
+            g = 0.1f * uniform(rng);
+        } while (g > q * q * std::pow(1.0f - q * q, 3.5f));
+        float escape = std::sqrt(2.0f) * std::pow(1.0f + r * r, -0.25f);
+
+        pos[i] = randomDirection(rng, r * scaleRadius);
+        vel[i] = randomDirection(rng, q * escape * velocityScale);
+        comPos += glm::dvec3(pos[i]);
+        comVel += glm::dvec3(vel[i]);
+    }
+
+    if (count > 0)
+    {
+        comPos /= (double)count;
+        comVel /= (double)count;
+    }
+    for (size_t i = 0; i < count; i++)
+        sim.addBody(pos[i] - glm::vec3(comPos), vel[i] - glm::vec3(comVel), m);
+}
+
+// Cold, equal-mass bodies scattered uniformly through a periodic box; switches
+// the simulation to periodic boundaries, sets the softening to 1/30 of
+// the mean spacing and the timestep to a sixth of sqrt(eps^3 / G m), the
+// time a close pair takes to cross one softening length. That is
+// sqrt(L^3 / G M) / 986 whatever the count: 0.001 with G = M = L = 1, where
+// the Poisson noise seeds the clustering and the collapse time is about 0.5.
+// ------------------------------------------------------------------------
+inline void createPeriodicBox(Simulation& sim, size_t count, float boxSize = 1.0f,
+    float totalMass = 1.0f, unsigned int seed = 42)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, boxSize);
+    const float m = count > 0 ? totalMass / count : 0.0f;
+
+    sim.clear();
+    sim.boxSize = boxSize;
+    sim.softening = boxSize / (30.0f * std::cbrt((float)std::max<size_t>(count, 1)));
+    sim.timeStep = std::sqrt(boxSize * boxSize * boxSize / (27000.0f * sim.G * totalMass)) / 6.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 pos(uniform(rng), uniform(rng), uniform(rng));
+        sim.addBody(glm::vec3(periodicWrap(pos.x, boxSize), periodicWrap(pos.y, boxSize), periodicWrap(pos.z, boxSize)),
+            glm::vec3(0.0f), m);
+    }
+}
+
+// Comoving x of a pancake plane with lattice coordinate q at scale factor a,
+// exact until the planes cross at aCross (see createZeldovichPancake)
+inline float zeldovichPosition(float q, double a, double aCross, float boxSize)
+{
+    const double k = 2.0 * glm::pi<double>() / boxSize;
+    return (float)(q - a / aCross * std::sin(k * q) / k);
+}
+
+// Zel'dovich pancake in an Einstein-de Sitter box (G, total mass and box size
+// fix H0): a lattice of nx * ny * ny bodies displaced along x by one sine
+// wave with the growing-mode momenta, switched to comoving integration at
+// aStart. The planes cross at aCross and until then zeldovichPosition is
+// the exact solution, which makes this the standard check of a comoving
+// integrator. Body ids follow the lattice, x fastest.
+// ------------------------------------------------------------------------
+inline void createZeldovichPancake(Simulation& sim, int nx, int ny, double aStart, double aCross = 1.0,
+    float boxSize = 1.0f, float totalMass = 1.0f)
+{
+    sim.clear();
+    sim.boxSize = boxSize;
+    sim.comoving = true;
+    sim.scaleFactor = aStart;
+    sim.cosmology = Cosmology();
+    sim.cosmology.hubble = Cosmology::hubbleFor(sim.G, totalMass / (boxSize * boxSize * boxSize), 1.0);
+    // well under the closest plane spacing at aCross / 2, or softening bends the sheet forces
+    sim.softening = 0.02f * boxSize / nx;
+
+    const double k = 2.0 * glm::pi<double>() / boxSize;
+    const double momentum = aStart * aStart * aStart * sim.cosmology.H(aStart) / aCross; // a^2 dx/dt per unit sin(kq)/k
+    const float m = totalMass / ((float)nx * ny * ny);
+    for (int l = 0; l < ny; l++)
+        for (int j = 0; j < ny; j++)
+            for (int i = 0; i < nx; i++)
+            {
+                float q = (i + 0.5f) * boxSize / nx;
+                glm::vec3 pos(zeldovichPosition(q, aStart, aCross, boxSize), (j + 0.5f) * boxSize / ny, (l + 0.5f) * boxSize / ny);
+                glm::vec3 w((float)(-momentum * std::sin(k * q) / k), 0.0f, 0.0f);
+                sim.addBody(glm::vec3(periodicWrap(pos.x, boxSize), pos.y, pos.z), w, m);
+            }
+}
+
+// Uniform gas in a periodic box with random velocities: Gaussian in each
+// component, rms Mach number `mach` against the sound speed of the internal
+// energy u, net momentum removed. Positions are random too, so the first
+// steps also relax the Poisson noise into pressure waves. With
+// sim.gravity = false it is a pure hydrodynamics test whose kinetic plus
+// thermal energy must stay constant while the viscosity turns one into the other.
+// ------------------------------------------------------------------------
+inline void createGasBox(Simulation& sim, size_t count, float boxSize = 1.0f, float totalMass = 1.0f,
+    float u = 1.0f, float mach = 0.0f, unsigned int seed = 42)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, boxSize);
+    const float m = count > 0 ? totalMass / count : 0.0f;
+    const float gamma = sim.sph.gamma;
+    const float sigma = mach * std::sqrt(gamma * (gamma - 1.0f) * u / 3.0f);
+
+    // a normal distribution needs a positive spread; mach 0 is gas at rest
+    std::vector<glm::vec3> vel(count, glm::vec3(0.0f));
+    glm::dvec3 mean(0.0);
+    if (sigma > 0.0f)
+    {
+        std::normal_distribution<float> normal(0.0f, sigma);
+        for (size_t i = 0; i < count; i++)
+        {
+            vel[i] = glm::vec3(normal(rng), normal(rng), normal(rng));
+            mean += glm::dvec3(vel[i]);
+        }
+        if (count > 0)
+            mean /= (double)count;
+    }
+
+    sim.clear();
+    sim.boxSize = boxSize;
+    sim.softening = boxSize / (30.0f * std::cbrt((float)std::max<size_t>(count, 1)));
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 pos(uniform(rng), uniform(rng), uniform(rng));
+        sim.addGas(glm::vec3(periodicWrap(pos.x, boxSize), periodicWrap(pos.y, boxSize), periodicWrap(pos.z, boxSize)),
+            vel[i] - glm::vec3(mean), m, u);
+    }
+}
+
+// Evrard (1988) collapse: a cold gas sphere of mass M and radius R with
+// rho proportional to 1 / r, at rest with u = 0.05 G M / R. It falls in,
+// bounces off a central shock near t = 0.8 (G = M = R = 1) and settles into
+// virial equilibrium, the standard test of gravity and SPH together.
+// ------------------------------------------------------------------------
+inline void createEvrardSphere(Simulation& sim, size_t count, float radius = 1.0f, float totalMass = 1.0f,
+    unsigned int seed = 42)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    const float m = count > 0 ? totalMass / count : 0.0f;
+    const float u = 0.05f * sim.G * totalMass / radius;
+
+    sim.clear();
+    sim.boxSize = 0.0f;
+    sim.softening = 0.02f * radius;
+    for (size_t i = 0; i < count; i++)
+    {
+        // M(r) grows as r^2
+        float r = radius * std::sqrt(uniform(rng));
+        float cosTheta = 2.0f * uniform(rng) - 1.0f;
+        float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        float phi = 2.0f * glm::pi<float>() * uniform(rng);
+        sim.addGas(r * glm::vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta), glm::vec3(0.0f), m, u);
+    }
+}
+#endif
@@ -1,4 +1,14 @@
 #include <iostream>
+#include <string>
+
+#include "Simulation.h"
+#include "InitialConditions.h"
+#include "Benchmark.h"
+#include "Headless.h"
+
+// GALAXY_HEADLESS builds only the command line modes, with no GLFW, GLAD or
+// OpenGL dependency, for machines without a display
+#ifndef GALAXY_HEADLESS
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
@@ -6,20 +16,24 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "Shader.h"
+#include "FrameUniforms.h"
 #include "Camera.h"
 #include "Sphere.h"
+#include "SimulationThread.h"
 
 // Variables
 unsigned int SCR_WIDTH = 1280;
 unsigned int SCR_HEIGHT = 720;
+const size_t STAR_COUNT = 2000;
 
 // GLFW Functions
 void processInput(GLFWwindow* window); // Function to process input
 void framebuffer_size_callback(GLFWwindow* window, int width, int height); // Resize
 void mouse_callback(GLFWwindow* window, double xPosIn, double yPosIn); // Mouse
+glm::vec4 starColor(unsigned int id); // Star tint
 
 // Camera
-Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+Camera camera(glm::vec3(0.0f, 0.0f, 150.0f));
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
@@ -28,9 +42,29 @@ bool firstClick = true;
 // Time Management
 float deltaTime = 0.0f; // time between current frame and last frame
 float lastFrame = 0.0f;
+#endif
 
-int main()
+int main(int argc, char* argv[])
 {
+    // Benchmarks run without a window
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+        return runBenchmarks(argc - 2, argv + 2);
+
+    // So do headless runs, which never touch GLFW or OpenGL
+    if (argc > 1 && std::string(argv[1]) == "--headless")
+        return runHeadless(argc - 2, argv + 2);
+
+#ifdef GALAXY_HEADLESS
+    return runHeadless(argc - 1, argv + 1);
+#else
+    // The windowed mode only takes a force solver: --solver direct|tree|pm|treepm|fmm
+    ForceSolver solver = ForceSolver::Direct;
+    for (int i = 1; i + 1 < argc; i++)
+    {
+        if (std::string(argv[i]) == "--solver")
+            solver = parseForceSolver(argv[++i]);
+    }
+
     // GLFW Initialization
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -70,52 +104,80 @@ int main()
     Shader defaultShader("default.vert", "default.frag");
     // We keep bloomShader if you still need mesh-based glow elsewhere, but we won't use it in this screen-space path.
     Shader bloomShader("bloom.vert", "bloom.frag");
-    Shader glowScreenShader("glow_screen.vert", "bloom.frag"); // NEW: screen-space glow pipeline
+    Shader glowShader("glow.vert", "glow.frag"); // screen-space glow, one bounded quad per star
 
-    // --- Geometry ---
-    unsigned int VAO;
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
+    // Camera matrices, viewport and time reach every program through one uniform buffer
+    FrameUniforms frameUniforms;
 
-    Sphere star(1.0f);
+    // Glow settings don't change per frame; the pulse is driven by FrameData.time
+    glowShader.use();
+    glowShader.setVec3("color", glm::vec3(1.0f)); // white glow
+    glowShader.setFloat("glowStrength", 2.0f);     // intensity
 
-    // Transform uniform location (if used by default shader)
-    unsigned int transformLoc = glGetUniformLocation(defaultShader.ID, "transform");
+    // --- Geometry ---
+    Sphere star(1.0f);
 
     // 3D Rendering state
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_BLEND); // We will toggle blend funcs around passes
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // ---- Full-screen quad for screen-space glow ----
-    unsigned int fsVAO = 0, fsVBO = 0;
+    // ---- Instanced quad for screen-space glow ----
+    unsigned int glowVAO = 0, glowQuadVBO = 0;
     {
-        // Triangle strip covering entire screen in NDC
-        float fsQuad[] = {
+        // Triangle strip corners; glow.vert scales them around each star
+        float quad[] = {
             -1.0f, -1.0f,
              1.0f, -1.0f,
             -1.0f,  1.0f,
              1.0f,  1.0f
         };
 
-        glGenVertexArrays(1, &fsVAO);
-        glGenBuffers(1, &fsVBO);
-        glBindVertexArray(fsVAO);
-
-        glBindBuffer(GL_ARRAY_BUFFER, fsVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(fsQuad), fsQuad, GL_STATIC_DRAW);
+        glGenVertexArrays(1, &glowVAO);
+        glGenBuffers(1, &glowQuadVBO);
+        glBindVertexArray(glowVAO);
 
+        glBindBuffer(GL_ARRAY_BUFFER, glowQuadVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
         glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(0);
 
         glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
 
     float time;
-    float distance;
 
-    glm::vec3 position[5];
-    glm::vec3 velocity[std::size(position)];
+    // --- Simulation ---
+    Simulation sim;
+    sim.solver = solver;
+    createDiskGalaxy(sim, STAR_COUNT);
+
+    const size_t starCount = sim.size();
+
+    // --- Star instances: colours are fixed, transforms are refreshed every frame ---
+    // instances are indexed by particle id, the order physics frames are published in
+    std::vector<glm::vec4> starTransforms(starCount);
+    std::vector<glm::vec4> starColors(starCount);
+    for (size_t i = 0; i < starCount; i++)
+        starColors[sim.particles.id[i]] = starColor(sim.particles.id[i]);
+    star.reserveInstances((GLsizei)starCount);
+    star.updateInstanceColors(starColors.data(), (GLsizei)starCount);
+
+    // the glow pass reads the same per-star centres as the spheres
+    glBindVertexArray(glowVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, star.instanceVbo);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribDivisor(1, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Physics runs on its own thread at 60 ticks per wall second and publishes
+    // finished states; from here on only the physics thread touches `sim`
+    SimulationThread physics(sim, SimulationClock(1.0 / 60.0, 1, 4));
+    physics.start();
+    unsigned long long stepsAtLastReport = 0;
 
     // ----- Main Loop -----
     while (!glfwWindowShouldClose(window))
@@ -130,124 +192,89 @@ int main()
         {
             std::cout << "FPS: " << frameCount << std::endl;
             std::cout << "Time: " << time << std::endl;
+            const PhysicsFrame& reported = physics.latest();
+            std::cout << "Simulation time: " << reported.time;
+            if (reported.comoving)
+                std::cout << " (a = " << reported.scaleFactor << ")";
+            std::cout << std::endl;
+            unsigned long long steps = reported.stepCount;
+            std::cout << "Physics steps/s: " << steps - stepsAtLastReport
+                << " (dropped ticks: " << physics.droppedTicks() << ")" << std::endl;
+            stepsAtLastReport = steps;
             frameCount = 0;
             previousTime = currentFrame;
         }
 
         processInput(window);
 
+        // Physics: pick up the newest published state without waiting for the solver
+        const PhysicsFrame& frame = physics.latest();
+        float alpha = physics.alpha(frame);
+
         // Render
         glClearColor(0.0f, 0.0f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // ---- Matrices ----
-        defaultShader.use();
-
+        // ---- Per-frame uniforms ----
         glm::mat4 projection = glm::mat4(1.0f);
         glm::mat4 view = glm::mat4(1.0f);
 
         view = camera.GetViewMatrix();
         projection = glm::perspective(glm::radians(45.0f), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
 
-        int viewLoc = glGetUniformLocation(defaultShader.ID, "view");
-        int projectionLoc = glGetUniformLocation(defaultShader.ID, "projection");
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
-        glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+        frameUniforms.update(view, projection, (float)SCR_WIDTH, (float)SCR_HEIGHT, time);
 
+        // ---- Stars: one instanced draw for all of them, between the last two physics states ----
+        for (size_t i = 0; i < starCount; i++)
+            starTransforms[i] = glm::vec4(frame.interpolate(i, alpha), star.getRadius());
+        star.updateInstanceTransforms(starTransforms.data(), (GLsizei)starCount);
+        defaultShader.use();
+        star.drawInstanced((GLsizei)starCount);
 
+        // ---- Glow: projection, pixel radius and frustum gate run in glow.vert ----
+        glDisable(GL_DEPTH_TEST);                // overlay; no depth clip
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE);       // additive blend
 
-        // ---- STEP 1: Compute sphere center + radius in screen space ----
-        for (unsigned int i = 0; i < std::size(position); i++)
-        {
-            distance = i * star.getRadius() * 8;
-            position[i] = glm::vec3(distance * sin(time * i * 0.25), distance * cos(time * i*0.25), 0.0f);
-            glm::vec3 sphereCenter = glm::vec3(position[i]);
-            float sphereRadius = star.getRadius(); // 1.0f
-
-            // Project center to clip/NDC
-            glm::vec4 clipCenter = projection * view * glm::vec4(sphereCenter, 1.0f);
-            glm::vec3 ndcCenter = glm::vec3(clipCenter) / clipCenter.w;
-
-            // Convert to screen pixels
-            glm::vec2 centerScreen;
-            centerScreen.x = (ndcCenter.x * 0.5f + 0.5f) * SCR_WIDTH;
-            centerScreen.y = (ndcCenter.y * 0.5f + 0.5f) * SCR_HEIGHT;
-
-            // Camera right (first column of view matrix) for pixel radius estimate
-            glm::vec3 cameraRight(view[0][0], view[1][0], view[2][0]);
-            cameraRight = glm::normalize(cameraRight);
-
-            glm::vec4 clipEdge = projection * view *
-                glm::vec4(sphereCenter + cameraRight * sphereRadius, 1.0f);
-            glm::vec3 ndcEdge = glm::vec3(clipEdge) / clipEdge.w;
-
-            glm::vec2 edgeScreen;
-            edgeScreen.x = (ndcEdge.x * 0.5f + 0.5f) * SCR_WIDTH;
-            edgeScreen.y = (ndcEdge.y * 0.5f + 0.5f) * SCR_HEIGHT;
-
-            float sphereRadiusPx = glm::length(edgeScreen - centerScreen);
-            float glowWidthPx = sphereRadiusPx * 0.4f; // tweak to taste
-
-            // ---- Visibility gate: only draw glow when sphere is in front and in frustum ----
-            glm::vec3 viewCenter = glm::vec3(view * glm::vec4(sphereCenter, 1.0f));
-            bool inFrontOfCamera = (viewCenter.z < 0.0f);
-
-            bool ndcValid = (clipCenter.w > 0.0f) &&
-                (ndcCenter.x >= -1.0f && ndcCenter.x <= 1.0f) &&
-                (ndcCenter.y >= -1.0f && ndcCenter.y <= 1.0f) &&
-                (ndcCenter.z >= -1.0f && ndcCenter.z <= 1.0f);
-
-            bool drawGlow = inFrontOfCamera && ndcValid;
-            // ---- Screen-space glow pass ----
-            if (drawGlow)
-            {
-                glDisable(GL_DEPTH_TEST);                // full-screen overlay; no depth clip
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE);       // additive blend
-
-                glowScreenShader.use();
-                glowScreenShader.setVec3("color", glm::vec3(1.0f));       // white glow
-                glowScreenShader.setFloat("glowStrength", sin(time * 3.5) / 4 + 2);          // intensity
-                glowScreenShader.setVec2("centerScreen", centerScreen);   // uniforms already computed
-                glowScreenShader.setFloat("sphereRadiusPx", sphereRadiusPx);
-                glowScreenShader.setFloat("glowWidthPx", glowWidthPx);
-                glowScreenShader.setFloat("time", time);
-
-                glBindVertexArray(fsVAO);
-                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-                glBindVertexArray(0);
-
-                // restore
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-                glDisable(GL_BLEND);
-                glEnable(GL_DEPTH_TEST);
-            }
-        }
+        glowShader.use();
+
+        glBindVertexArray(glowVAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)starCount);
+        glBindVertexArray(0);
+
+        // restore
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
     // Cleanup
+    physics.stop();
     glBindVertexArray(0);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteVertexArrays(1, &fsVAO);
-    glDeleteBuffers(1, &fsVBO);
+    glDeleteVertexArrays(1, &glowVAO);
+    glDeleteBuffers(1, &glowQuadVBO);
 
     glDeleteShader(defaultShader.ID);
     glDeleteShader(bloomShader.ID);
-    glDeleteShader(glowScreenShader.ID);
+    glDeleteShader(glowShader.ID);
 
     glfwTerminate();
     return 0;
+#endif
 }
 
+#ifndef GALAXY_HEADLESS
+
 void processInput(GLFWwindow* window)
 {
     // -- WINDOW --
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     {
-        exit(EXIT_FAILURE);
+        // leave the loop normally so the physics thread is joined before exit
+        glfwSetWindowShouldClose(window, true);
     }
     // -- MOVEMENT --
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) { camera.ProcessKeyboard(FORWARD, deltaTime); }
@@ -308,7 +335,18 @@ void mouse_callback(GLFWwindow* window, double xPosIn, double yPosIn)
     camera.ProcessMouseMovement(xOffset, yOffset);
 }
 
-void updatePosition(glm::vec3& position, glm::vec3 movement)
+glm::vec4 starColor(unsigned int id)
 {
-    
-}
\ No newline at end of file
+    // pick from blue-white to orange with a cheap integer hash of the id
+    const glm::vec3 palette[] = {
+        glm::vec3(0.65f, 0.75f, 1.0f),
+        glm::vec3(0.85f, 0.9f, 1.0f),
+        glm::vec3(1.0f, 0.97f, 0.9f),
+        glm::vec3(1.0f, 0.9f, 0.65f),
+        glm::vec3(1.0f, 0.75f, 0.5f)
+    };
+    unsigned int h = id * 2654435761u;
+    h ^= h >> 16;
+    return glm::vec4(palette[h % 5], 1.0f);
+}
+#endif
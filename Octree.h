@@ -0,0 +1,1259 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <chrono>
+#include <utility>
+#include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+#include "GravityKernels.h"
+#include "GravityQuadrupoleKernels.h"
+#include "GravityShortRangeKernels.h"
+#include "Ewald.h"
+
+// Barnes-Hut octree with monopole + quadrupole moments.
+//
+// Nodes are stored in one flat array; the children of a node are contiguous
+// and only non-empty octants get a child. Every node owns a contiguous range
+// [begin, end) of Octree::index, which lists the particles sorted by cell.
+struct OctreeNode
+{
+    glm::vec3 center;   // geometric centre of the cubic cell
+    float halfSize;     // half the cell edge length
+    glm::vec3 com;      // centre of mass
+    float mass;
+    float quad[6];      // traceless quadrupole about com: xx, xy, xz, yy, yz, zz
+    float spread;       // sum of m |x - com|^2, the trace the quadrupole leaves out
+    float openRadius2;  // the cell is opened for targets closer than sqrt(openRadius2)
+    int firstChild;     // -1 for leaves
+    int childCount;
+    unsigned int begin, end;
+};
+
+class Octree
+{
+public:
+    float theta = 0.5f;             // opening angle; 0 degenerates to direct summation
+    unsigned int leafSize = 8;      // max particles in a leaf
+    bool useQuadrupole = true;
+    static const int maxDepth = 32; // stops splitting coincident particles
+
+    // TreePM short-range mode: with splitRadius > 0 the walk only sums the
+    // erfc-screened part of the force and ignores everything beyond
+    // cutoff * splitRadius (see TreePM.h); 0 is plain Newtonian gravity.
+    // Cells keep their quadrupole, screened too (GravityShortRangeKernels.h).
+    float splitRadius = 0.0f;
+    float cutoff = 4.5f;
+
+    // Relative opening criterion (GADGET-2): with errorTolerance > 0 a cell is
+    // accepted when its first neglected multipole term, M/r^2 (l/r)^p, is below
+    // errorTolerance times the target's previous acceleration; p is 3 with
+    // quadrupoles and 2 without. The previous acceleration is whatever ax/ay/az
+    // hold when the walk starts, divided by accelerationScale (Simulation keeps
+    // G a there). Cells containing the target, grown by 20%, are always opened.
+    // Targets without a previous acceleration (the first evaluation, new bodies)
+    // fall back to theta, and so does the TreePM short-range walk.
+    float errorTolerance = 0.0f;
+    float accelerationScale = 1.0f;
+
+    // Periodic mode: with boxSize > 0 the particles live in [0, boxSize)^3
+    // and every cell and body is seen at its nearest image, plus the Ewald
+    // correction for the other images. For cells the table gives the
+    // monopole of the correction; its quadrupole comes from the images one
+    // box away across each face the com is more than a quarter box from,
+    // which carry nearly all of it. Cells wider than a quarter of the box are
+    // always opened. Softening applies to the nearest image only, so keep it
+    // well below the box. Uses the per-body walk.
+    float boxSize = 0.0f;
+
+    // Refitting: with refit on, update() keeps the topology and particle
+    // order of the last build and only recomputes boxes and moments,
+    // bottom-up one level at a time. Boxes grow as bodies drift apart; once
+    // the summed node volume passes refitGrowth times its value at the last
+    // build, the tree is rebuilt instead.
+    bool refit = false;
+    float refitGrowth = 1.5f;
+
+    // Group walk: bodies are taken in buckets, the largest subtrees with at
+    // most groupSize bodies. Each bucket walks the tree once against its
+    // bounding box and gets one shared interaction list: the bodies of opened
+    // leaves, plus accepted cells as point masses and quadrupoles. The list is
+    // then evaluated for every body of the bucket with the SIMD kernels.
+    // The TreePM short-range mode builds its lists the same way, skipping
+    // everything beyond the cutoff from the bucket's box, and evaluates them
+    // with the screened kernels. 0 walks one body at a time.
+    unsigned int groupSize = 32;
+
+    // last evaluation: wall time, body-source interactions and mean list
+    // length (group walk only)
+    double walkSeconds = 0.0;
+    unsigned long long interactions = 0;
+    double meanListLength = 0.0;
+
+    // since construction: how often each path ran and the time it took
+    unsigned long long rebuilds = 0, refits = 0;
+    double buildSeconds = 0.0, refitSeconds = 0.0;
+    float growth = 1.0f; // node volume relative to the last build
+
+    std::vector<OctreeNode> nodes;
+    std::vector<unsigned int> index;
+
+    // build the tree for the given particles
+    // ------------------------------------------------------------------------
+    void build(const ParticleStore& particles)
+    {
+        auto start = std::chrono::steady_clock::now();
+        buildTree(particles);
+        if (refit)
+        {
+            // start from tight boxes too, so growth measures drift and not the
+            // difference to the geometric cells
+            orderLevels();
+            refitLevels(particles);
+        }
+        builtVolume = nodeVolume();
+        growth = 1.0f;
+        valid = true;
+        rebuilds++;
+        buildSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // refit when allowed and still good enough, rebuild otherwise
+    // ------------------------------------------------------------------------
+    void update(const ParticleStore& particles)
+    {
+        if (!refit || !valid || nodes.empty() || index.size() != particles.size() || levelStart.empty())
+        {
+            build(particles);
+            return;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        refitLevels(particles);
+        growth = (float)(nodeVolume() / builtVolume);
+        refits++;
+        refitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (growth > refitGrowth)
+            build(particles);
+    }
+
+    // the next update() rebuilds
+    void invalidate()
+    {
+        valid = false;
+    }
+
+    // particles were reordered with ParticleStore::permute(order): follow them,
+    // so the topology survives and refitting can carry on
+    void remap(const std::vector<uint32_t>& order)
+    {
+        if (order.size() != index.size())
+        {
+            invalidate();
+            return;
+        }
+        std::vector<unsigned int> newIndex(order.size());
+        for (size_t i = 0; i < order.size(); i++)
+            newIndex[order[i]] = (unsigned int)i;
+        for (unsigned int& i : index)
+            i = newIndex[i];
+    }
+
+    // acceleration (without G) at position p; 'self' is skipped in leaf
+    // interactions, pass an out-of-range index for an external point
+    // ------------------------------------------------------------------------
+    glm::vec3 acceleration(const glm::vec3& p, unsigned int self, const ParticleStore& particles, float softening) const
+    {
+        if (splitRadius > 0.0f)
+            return shortRangeAcceleration(p, self, particles, softening);
+        if (boxSize > 0.0f)
+            return periodicAcceleration(p, self, particles, softening);
+
+        const float* x = particles.x.data();
+        const float* y = particles.y.data();
+        const float* z = particles.z.data();
+        const float* m = particles.mass.data();
+        const float eps2 = softening * softening;
+        const float limit = errorLimit(particles, self);
+        glm::vec3 acc(0.0f);
+        if (nodes.empty())
+            return acc;
+
+        int stack[8 * maxDepth + 8];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0)
+        {
+            const OctreeNode& node = nodes[stack[--top]];
+            glm::vec3 d = node.com - p;
+            float d2 = glm::dot(d, d);
+
+            if (accepts(node, p - node.center, d2, limit))
+            {
+                acc += cellAcceleration(node, d, d2, eps2);
+            }
+            else if (node.firstChild < 0)
+            {
+                for (unsigned int k = node.begin; k < node.end; k++)
+                {
+                    unsigned int j = index[k];
+                    if (j == self)
+                        continue;
+                    glm::vec3 dj(x[j] - p.x, y[j] - p.y, z[j] - p.z);
+                    float r2 = glm::dot(dj, dj) + eps2;
+                    float invR = 1.0f / std::sqrt(r2);
+                    acc += dj * (m[j] * invR * invR * invR);
+                }
+            }
+            else
+            {
+                for (int c = 0; c < node.childCount; c++)
+                    stack[top++] = node.firstChild + c;
+            }
+        }
+        return acc;
+    }
+
+    // update the tree and write accelerations (without G) for every particle into ax/ay/az
+    // ------------------------------------------------------------------------
+    void accelerations(ParticleStore& particles, float softening)
+    {
+        update(particles);
+        prepareScreening();
+        if (groupSize > 0 && boxSize <= 0.0f)
+        {
+            groupAccelerations(particles, softening, nullptr);
+            return;
+        }
+
+        if (boxSize > 0.0f)
+            ewaldTable(); // open or build it here, before the walk fans out
+        auto start = std::chrono::steady_clock::now();
+        // walking in tree order keeps consecutive targets close together, and
+        // gives each chunk of the parallel loop a compact group of targets
+        parallelFor(0, index.size(), [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                unsigned int i = index[k];
+                particles.setAcceleration(i, acceleration(particles.position(i), i, particles, softening));
+            }
+        }, 64);
+        walkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // update the tree and write accelerations only for the listed targets
+    // ------------------------------------------------------------------------
+    void accelerations(ParticleStore& particles, float softening, const std::vector<uint32_t>& targets)
+    {
+        update(particles);
+        prepareScreening();
+        if (groupSize > 0 && boxSize <= 0.0f)
+        {
+            active.assign(particles.size(), 0);
+            for (uint32_t i : targets)
+                active[i] = 1;
+            groupAccelerations(particles, softening, &active);
+            return;
+        }
+
+        if (boxSize > 0.0f)
+            ewaldTable();
+        auto start = std::chrono::steady_clock::now();
+        parallelFor(0, targets.size(), [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                uint32_t i = targets[k];
+                particles.setAcceleration(i, acceleration(particles.position(i), i, particles, softening));
+            }
+        }, 64);
+        walkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Prediction, for block timesteps: after beginPrediction() the tree keeps
+    // serving group walks while the bodies move on, without a rebuild or a
+    // refit. Time t counts from the call. Every node moves with the mean
+    // velocity of its bodies and its cube grows by a bound on their speed
+    // relative to that mean, times t; leaf bodies are read at
+    // x + v (t - drifted[j]), drifted[j] being the time their stored position
+    // belongs to. kick() hands a body's velocity change to the nodes above
+    // it, so both stay exact for bodies moving in straight lines between
+    // kicks. Quadrupoles keep their value from the build.
+    // ------------------------------------------------------------------------
+    void beginPrediction(const ParticleStore& particles)
+    {
+        const size_t count = nodes.size();
+        parent.assign(count, -1);
+        predicted.resize(count);
+        bodyLeaf.resize(particles.size());
+        for (size_t c = 0; c < count; c++)
+        {
+            const OctreeNode& node = nodes[c];
+            for (int k = 0; k < node.childCount; k++)
+                parent[node.firstChild + k] = (int)c;
+            if (node.firstChild < 0)
+            {
+                for (unsigned int k = node.begin; k < node.end; k++)
+                    bodyLeaf[index[k]] = (int)c;
+            }
+        }
+
+        // children sit after their parent, so a backward pass goes bottom-up
+        for (size_t c = count; c-- > 0;)
+        {
+            const OctreeNode& node = nodes[c];
+            glm::vec3 v(0.0f);
+            float speed = 0.0f;
+            if (node.firstChild < 0)
+            {
+                for (unsigned int k = node.begin; k < node.end; k++)
+                    v += particles.mass[index[k]] * particles.velocity(index[k]);
+                v = node.mass > 0.0f ? v / node.mass : glm::vec3(0.0f);
+                for (unsigned int k = node.begin; k < node.end; k++)
+                    speed = std::max(speed, glm::length(particles.velocity(index[k]) - v));
+            }
+            else
+            {
+                for (int k = 0; k < node.childCount; k++)
+                    v += nodes[node.firstChild + k].mass * predicted[node.firstChild + k].velocity;
+                v = node.mass > 0.0f ? v / node.mass : glm::vec3(0.0f);
+                for (int k = 0; k < node.childCount; k++)
+                {
+                    const int child = node.firstChild + k;
+                    speed = std::max(speed, predicted[child].speed + glm::length(predicted[child].velocity - v));
+                }
+            }
+            predicted[c] = { node.com, speed, v, std::sqrt(node.openRadius2) };
+        }
+
+        collectGroups();
+        bodyGroup.resize(particles.size());
+        for (size_t g = 0; g < groups.size(); g++)
+        {
+            const OctreeNode& group = nodes[groups[g]];
+            for (unsigned int k = group.begin; k < group.end; k++)
+                bodyGroup[index[k]] = (uint32_t)g;
+        }
+        groupMark.assign(groups.size(), 0);
+        predictMask.assign(particles.size(), 0);
+    }
+
+    // body i changed its velocity by dv at time t
+    void kick(uint32_t i, const glm::vec3& dv, float t, float mass)
+    {
+        const float change = glm::length(dv);
+        for (int c = bodyLeaf[i]; c >= 0; c = parent[c])
+        {
+            if (nodes[c].mass <= 0.0f)
+                continue;
+            glm::vec3 share = dv * (mass / nodes[c].mass);
+            predicted[c].velocity += share;
+            predicted[c].base -= share * t;
+            predicted[c].speed += change;
+        }
+    }
+
+    // accelerations (without G) of the listed targets at time t, whose stored
+    // positions must belong to t; only the buckets holding a target are walked
+    void predictedAccelerations(ParticleStore& particles, float softening, const std::vector<uint32_t>& targets,
+        float t, const std::vector<float>& drifted)
+    {
+        std::vector<uint32_t> selection;
+        for (uint32_t i : targets)
+        {
+            predictMask[i] = 1;
+            uint32_t g = bodyGroup[i];
+            if (!groupMark[g])
+            {
+                groupMark[g] = 1;
+                selection.push_back(g);
+            }
+        }
+        const Prediction prediction = { t, &drifted };
+        groupAccelerations(particles, softening, &predictMask, &prediction, &selection);
+        for (uint32_t g : selection)
+            groupMark[g] = 0;
+        for (uint32_t i : targets)
+            predictMask[i] = 0;
+    }
+
+private:
+    std::vector<unsigned int> scratch;
+    std::vector<int> groups;
+    std::vector<char> active;
+
+    // prediction state, see beginPrediction: a node's com at time t is
+    // base + velocity t, speed bounds its bodies' speed relative to velocity
+    // and radius is the square root of its openRadius2 when it was built
+    struct Prediction
+    {
+        float time;
+        const std::vector<float>* drifted;
+    };
+    struct PredictedCell
+    {
+        glm::vec3 base;
+        float speed;
+        glm::vec3 velocity;
+        float radius;
+    };
+    std::vector<PredictedCell> predicted;
+    std::vector<int> parent, bodyLeaf;
+    std::vector<uint32_t> bodyGroup;
+    std::vector<char> groupMark, predictMask;
+
+    glm::vec3 predictedPosition(const ParticleStore& particles, unsigned int j, const Prediction& prediction) const
+    {
+        return particles.position(j) + particles.velocity(j) * (prediction.time - (*prediction.drifted)[j]);
+    }
+
+    // one bucket's interaction list; monopoles of the cells sit after the bodies
+    struct InteractionList
+    {
+        std::vector<float> x, y, z, m;
+        std::vector<float> cx, cy, cz, cm, q[6], cs; // cs: spread, short-range lists only
+
+        void clear()
+        {
+            for (std::vector<float>* v : { &x, &y, &z, &m, &cx, &cy, &cz, &cm, &q[0], &q[1], &q[2], &q[3], &q[4], &q[5], &cs })
+                v->clear();
+        }
+
+        // the cell monopoles go after the bodies, through the same point-mass kernel
+        void appendCellMonopoles()
+        {
+            x.insert(x.end(), cx.begin(), cx.end());
+            y.insert(y.end(), cy.begin(), cy.end());
+            z.insert(z.end(), cz.begin(), cz.end());
+            m.insert(m.end(), cm.begin(), cm.end());
+        }
+    };
+
+    // bucket roots: the largest subtrees with at most groupSize bodies
+    void collectGroups()
+    {
+        groups.clear();
+        if (nodes.empty())
+            return;
+        std::vector<int> stack(1, 0);
+        while (!stack.empty())
+        {
+            const int ni = stack.back();
+            stack.pop_back();
+            const OctreeNode& node = nodes[ni];
+            if (node.firstChild < 0 || node.end - node.begin <= groupSize)
+            {
+                groups.push_back(ni);
+                continue;
+            }
+            for (int c = 0; c < node.childCount; c++)
+                stack.push_back(node.firstChild + c);
+        }
+    }
+
+    // Builds the list of one bucket. A cell is accepted when the criterion holds
+    // for the point of the bucket's box nearest to the cell's com, and so for
+    // every body in the bucket; limit is the smallest of the bodies'
+    // errorLimit(). The bucket's own bodies end up in the list too; with
+    // softening > 0 a body adds exactly zero to itself. With a prediction the
+    // cells and bodies are taken where they are at its time.
+    void buildList(const ParticleStore& particles, const glm::vec3& lo, const glm::vec3& hi, float limit, InteractionList& list,
+        const Prediction* prediction = nullptr) const
+    {
+        list.clear();
+        int stack[8 * maxDepth + 8];
+        int top = 0;
+        stack[top++] = 0;
+        // a predicted cell moves with its mean velocity and grows by how far
+        // its bodies can have moved apart; the com keeps its place in the
+        // box, so the open radius grows by twice that over theta
+        const float growth = theta > 0.0f ? 2.0f / theta : 0.0f;
+        while (top > 0)
+        {
+            const int ni = stack[--top];
+            const OctreeNode& node = nodes[ni];
+            glm::vec3 com = node.com, center = node.center;
+            float halfSize = node.halfSize, openRadius2 = node.openRadius2;
+            if (prediction)
+            {
+                const PredictedCell& cell = predicted[ni];
+                const float spread = cell.speed * prediction->time;
+                com = cell.base + cell.velocity * prediction->time;
+                center += com - node.com;
+                halfSize += spread;
+                const float radius = cell.radius + growth * spread;
+                openRadius2 = radius * radius;
+            }
+            glm::vec3 d = glm::clamp(com, lo, hi) - com;
+            if (accepts(node.mass, halfSize, openRadius2, glm::clamp(center, lo, hi) - center, glm::dot(d, d), limit))
+            {
+                list.cx.push_back(com.x);
+                list.cy.push_back(com.y);
+                list.cz.push_back(com.z);
+                list.cm.push_back(node.mass);
+                for (int k = 0; k < 6; k++)
+                    list.q[k].push_back(node.quad[k]);
+            }
+            else if (node.firstChild < 0)
+            {
+                for (unsigned int k = node.begin; k < node.end; k++)
+                {
+                    unsigned int j = index[k];
+                    glm::vec3 pj = prediction ? predictedPosition(particles, j, *prediction) : particles.position(j);
+                    list.x.push_back(pj.x);
+                    list.y.push_back(pj.y);
+                    list.z.push_back(pj.z);
+                    list.m.push_back(particles.mass[j]);
+                }
+            }
+            else
+            {
+                for (int c = 0; c < node.childCount; c++)
+                    stack[top++] = node.firstChild + c;
+            }
+        }
+
+        list.appendCellMonopoles();
+    }
+
+    // The TreePM short-range list of one bucket: as buildList with the theta
+    // criterion, but cells whose box is a cutoff or more from the bucket's
+    // box are dropped unopened, and so are leaf bodies that far from it.
+    // The kernels cut off the remaining pairs one by one.
+    void buildShortRangeList(const ParticleStore& particles, const glm::vec3& lo, const glm::vec3& hi, InteractionList& list) const
+    {
+        const float rcut = cutoff * splitRadius, rcut2 = rcut * rcut;
+        list.clear();
+        int stack[8 * maxDepth + 8];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const OctreeNode& node = nodes[stack[--top]];
+            const glm::vec3 half(node.halfSize);
+            glm::vec3 gap = glm::max(glm::max(lo - (node.center + half), (node.center - half) - hi), glm::vec3(0.0f));
+            if (glm::dot(gap, gap) >= rcut2)
+                continue;
+
+            glm::vec3 d = glm::clamp(node.com, lo, hi) - node.com;
+            if (accepts(node, glm::clamp(node.center, lo, hi) - node.center, glm::dot(d, d), 0.0f))
+            {
+                list.cx.push_back(node.com.x);
+                list.cy.push_back(node.com.y);
+                list.cz.push_back(node.com.z);
+                list.cm.push_back(node.mass);
+                for (int k = 0; k < 6; k++)
+                    list.q[k].push_back(node.quad[k]);
+                list.cs.push_back(node.spread);
+            }
+            else if (node.firstChild < 0)
+            {
+                for (unsigned int k = node.begin; k < node.end; k++)
+                {
+                    unsigned int j = index[k];
+                    glm::vec3 p = particles.position(j);
+                    glm::vec3 out = glm::max(glm::max(lo - p, p - hi), glm::vec3(0.0f));
+                    if (glm::dot(out, out) >= rcut2)
+                        continue;
+                    list.x.push_back(p.x);
+                    list.y.push_back(p.y);
+                    list.z.push_back(p.z);
+                    list.m.push_back(particles.mass[j]);
+                }
+            }
+            else
+            {
+                for (int c = 0; c < node.childCount; c++)
+                    stack[top++] = node.firstChild + c;
+            }
+        }
+        list.appendCellMonopoles();
+    }
+
+    // group walk over the buckets in parallel, all of them or the selected
+    // ones (positions in groups); mask, when given, selects the targets and
+    // the bucket's box is taken around those alone. With splitRadius > 0 the
+    // lists and kernels are the screened ones. A prediction walks the tree
+    // as of beginPrediction(), whose buckets it keeps.
+    void groupAccelerations(ParticleStore& particles, float softening, const std::vector<char>* mask,
+        const Prediction* prediction = nullptr, const std::vector<uint32_t>* selection = nullptr)
+    {
+        auto start = std::chrono::steady_clock::now();
+        if (!prediction)
+            collectGroups();
+        const size_t groupCount = selection ? selection->size() : groups.size();
+        const float eps2 = softening * softening;
+        const bool screened = splitRadius > 0.0f;
+        const GravityScreening screening = screened ? screeningTables() : GravityScreening();
+        const GravityKernelFn kernel = gravityKernel();
+        const GravityQuadrupoleKernelFn quadrupoleKernel = gravityQuadrupoleKernel();
+        const GravityShortRangeKernelFn shortKernel = gravityShortRangeKernel();
+        const GravityShortRangeQuadrupoleKernelFn shortQuadrupoleKernel = gravityShortRangeQuadrupoleKernel();
+
+        typedef std::pair<unsigned long long, unsigned long long> Counts; // interactions, list entries
+        Counts counts = parallelReduce(0, groupCount, Counts(0, 0), [&](size_t b, size_t e)
+        {
+            Counts chunk(0, 0);
+            InteractionList list;
+            for (size_t g = b; g < e; g++)
+            {
+                const OctreeNode& group = nodes[groups[selection ? (*selection)[g] : g]];
+                bool any = false;
+                float limit = 3.0e38f;
+                glm::vec3 lo(3.0e38f), hi(-3.0e38f);
+                for (unsigned int k = group.begin; k < group.end; k++)
+                {
+                    unsigned int i = index[k];
+                    if (!mask || (*mask)[i])
+                    {
+                        any = true;
+                        lo = glm::min(lo, particles.position(i));
+                        hi = glm::max(hi, particles.position(i));
+                        limit = std::min(limit, errorLimit(particles, i));
+                    }
+                }
+                if (!any)
+                    continue;
+
+                if (screened)
+                    buildShortRangeList(particles, lo, hi, list);
+                else
+                    buildList(particles, lo, hi, limit, list, prediction);
+                const GravitySources sources = { list.x.data(), list.y.data(), list.z.data(), list.m.data(), list.x.size() };
+                const GravityQuadrupoleSources cells = { list.cx.data(), list.cy.data(), list.cz.data(),
+                    { list.q[0].data(), list.q[1].data(), list.q[2].data(), list.q[3].data(), list.q[4].data(), list.q[5].data() },
+                    useQuadrupole ? list.cx.size() : 0 };
+                const GravityScreenedCells screenedCells = { cells.x, cells.y, cells.z,
+                    { cells.q[0], cells.q[1], cells.q[2], cells.q[3], cells.q[4], cells.q[5] }, list.cs.data(), cells.count };
+
+                for (unsigned int k = group.begin; k < group.end; k++)
+                {
+                    unsigned int i = index[k];
+                    if (mask && !(*mask)[i])
+                        continue;
+                    float acc[3], quad[3] = { 0.0f, 0.0f, 0.0f };
+                    if (screened)
+                    {
+                        shortKernel(sources, screening, particles.x[i], particles.y[i], particles.z[i], eps2, acc);
+                        if (cells.count > 0)
+                            shortQuadrupoleKernel(screenedCells, screening, particles.x[i], particles.y[i], particles.z[i], eps2, quad);
+                    }
+                    else
+                    {
+                        kernel(sources, particles.x[i], particles.y[i], particles.z[i], eps2, acc);
+                        if (cells.count > 0)
+                            quadrupoleKernel(cells, particles.x[i], particles.y[i], particles.z[i], eps2, quad);
+                    }
+                    particles.setAcceleration(i, glm::vec3(acc[0] + quad[0], acc[1] + quad[1], acc[2] + quad[2]));
+                    chunk.first += sources.count;
+                }
+                chunk.second += sources.count;
+            }
+            return chunk;
+        },
+        [](const Counts& a, const Counts& b) { return Counts(a.first + b.first, a.second + b.second); },
+        1);
+
+        interactions = counts.first;
+        meanListLength = groupCount == 0 ? 0.0 : (double)counts.second / groupCount;
+        walkSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool valid = false;
+    double builtVolume = 1.0;
+    // node indices sorted by depth; level L is levelOrder[levelStart[L] .. levelStart[L + 1])
+    std::vector<int> levelOrder;
+    std::vector<unsigned int> levelStart;
+
+    double nodeVolume() const
+    {
+        double volume = 0.0;
+        for (const OctreeNode& node : nodes)
+            volume += (double)node.halfSize * node.halfSize * node.halfSize;
+        return std::max(volume, 1e-30);
+    }
+
+    void orderLevels()
+    {
+        levelOrder.assign(1, 0);
+        levelStart.assign(1, 0);
+        size_t begin = 0;
+        while (begin < levelOrder.size())
+        {
+            const size_t end = levelOrder.size();
+            levelStart.push_back((unsigned int)end);
+            for (size_t k = begin; k < end; k++)
+            {
+                const OctreeNode& node = nodes[levelOrder[k]];
+                for (int c = 0; c < node.childCount; c++)
+                    levelOrder.push_back(node.firstChild + c);
+            }
+            begin = end;
+        }
+    }
+
+    // Deepest level first, each level in parallel: leaves take the bounding
+    // cube of their bodies, inner nodes the cube around their children's.
+    // The cubes replace the build's geometric cells, which the bodies may
+    // have left; the walks only need a cube that holds them.
+    void refitLevels(const ParticleStore& particles)
+    {
+        for (size_t level = levelStart.size() - 1; level-- > 0;)
+        {
+            parallelFor(levelStart[level], levelStart[level + 1], [&](size_t b, size_t e)
+            {
+                for (size_t k = b; k < e; k++)
+                {
+                    OctreeNode& node = nodes[levelOrder[k]];
+                    glm::vec3 lo, hi;
+                    if (node.firstChild < 0)
+                    {
+                        lo = hi = particles.position(index[node.begin]);
+                        for (unsigned int j = node.begin + 1; j < node.end; j++)
+                        {
+                            lo = glm::min(lo, particles.position(index[j]));
+                            hi = glm::max(hi, particles.position(index[j]));
+                        }
+                    }
+                    else
+                    {
+                        const OctreeNode& first = nodes[node.firstChild];
+                        lo = first.center - glm::vec3(first.halfSize);
+                        hi = first.center + glm::vec3(first.halfSize);
+                        for (int c = 1; c < node.childCount; c++)
+                        {
+                            const OctreeNode& child = nodes[node.firstChild + c];
+                            lo = glm::min(lo, child.center - glm::vec3(child.halfSize));
+                            hi = glm::max(hi, child.center + glm::vec3(child.halfSize));
+                        }
+                    }
+                    glm::vec3 extent = hi - lo;
+                    node.center = 0.5f * (lo + hi);
+                    node.halfSize = 0.5f * std::max(extent.x, std::max(extent.y, extent.z)) * 1.0001f + 1e-6f;
+
+                    if (node.firstChild < 0)
+                        leafMoments(node, particles);
+                    else
+                        nodeMoments(nodes, node);
+                }
+            }, 64);
+        }
+    }
+
+    // erfc screening factors tabulated in (r / rcut)^2, see buildShortRangeTables
+    static const int SHORT_RANGE_TABLE = 1024;
+    std::vector<float> shortRangeTables[2];
+    float tableSplit = 0.0f, tableCutoff = 0.0f;
+
+    // With u = r / (2 rs): g = erfc(u) + 2u / sqrt(pi) exp(-u^2), the share of
+    // the Newtonian force left after the mesh has taken the long-range part,
+    // and H = 4u^3 / (3 sqrt(pi)) exp(-u^2), which the screened quadrupole
+    // adds (see GravityShortRangeKernels.h)
+    void buildShortRangeTables()
+    {
+        const double rcut = cutoff * splitRadius;
+        const double rootPi = std::sqrt(3.14159265358979323846);
+        for (std::vector<float>& table : shortRangeTables)
+            table.resize(SHORT_RANGE_TABLE + 1);
+        for (int k = 0; k <= SHORT_RANGE_TABLE; k++)
+        {
+            double u = rcut * std::sqrt((double)k / SHORT_RANGE_TABLE) / (2.0 * splitRadius);
+            shortRangeTables[0][k] = (float)(std::erfc(u) + 2.0 * u / rootPi * std::exp(-u * u));
+            shortRangeTables[1][k] = (float)(4.0 * u * u * u / (3.0 * rootPi) * std::exp(-u * u));
+        }
+        tableSplit = splitRadius;
+        tableCutoff = cutoff;
+    }
+
+    // TreePM resets splitRadius before every solve, and a refit keeps the tree
+    void prepareScreening()
+    {
+        if (splitRadius > 0.0f && (tableSplit != splitRadius || tableCutoff != cutoff))
+            buildShortRangeTables();
+    }
+
+    GravityScreening screeningTables() const
+    {
+        const float rcut = cutoff * splitRadius;
+        return { shortRangeTables[0].data(), shortRangeTables[1].data(), (float)SHORT_RANGE_TABLE / (rcut * rcut),
+            0.25f / (splitRadius * splitRadius), SHORT_RANGE_TABLE };
+    }
+
+    // Same walk as acceleration() in a periodic box, see boxSize
+    glm::vec3 periodicAcceleration(const glm::vec3& p, unsigned int self, const ParticleStore& particles, float softening) const
+    {
+        const EwaldTable& table = ewaldTable();
+        const float eps2 = softening * softening;
+        const float limit = errorLimit(particles, self);
+        const float widest = 0.125f * boxSize; // half of a quarter box
+        glm::vec3 acc(0.0f);
+        if (nodes.empty())
+            return acc;
+
+        int stack[8 * maxDepth + 8];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0)
+        {
+            const OctreeNode& node = nodes[stack[--top]];
+            glm::vec3 d = periodicDelta(node.com - p, boxSize);
+            float d2 = glm::dot(d, d);
+
+            if (node.halfSize <= widest && accepts(node, periodicDelta(p - node.center, boxSize), d2, limit))
+            {
+                acc += cellAcceleration(node, d, d2, eps2) + node.mass * table.acceleration(d, boxSize);
+                if (useQuadrupole)
+                    acc += imageQuadrupoles(node, d, eps2);
+            }
+            else if (node.firstChild < 0)
+            {
+                for (unsigned int k = node.begin; k < node.end; k++)
+                {
+                    unsigned int j = index[k];
+                    if (j == self)
+                        continue;
+                    glm::vec3 dj = periodicDelta(particles.position(j) - p, boxSize);
+                    float invR = 1.0f / std::sqrt(glm::dot(dj, dj) + eps2);
+                    acc += particles.mass[j] * (dj * (invR * invR * invR) + table.acceleration(dj, boxSize));
+                }
+            }
+            else
+            {
+                for (int c = 0; c < node.childCount; c++)
+                    stack[top++] = node.firstChild + c;
+            }
+        }
+        return acc;
+    }
+
+    // Same walk as acceleration() with screened monopoles and quadrupoles
+    // (see GravityShortRangeKernels.h) and cells whose box lies entirely
+    // beyond the cutoff skipped without looking at their contents.
+    glm::vec3 shortRangeAcceleration(const glm::vec3& p, unsigned int self, const ParticleStore& particles, float softening) const
+    {
+        const float* x = particles.x.data();
+        const float* y = particles.y.data();
+        const float* z = particles.z.data();
+        const float* m = particles.mass.data();
+        const float eps2 = softening * softening;
+        const float rcut = cutoff * splitRadius;
+        const float rcut2 = rcut * rcut;
+        const GravityScreening screening = screeningTables();
+        glm::vec3 acc(0.0f);
+        if (nodes.empty())
+            return acc;
+
+        int stack[8 * maxDepth + 8];
+        int top = 0;
+        stack[top++] = 0;
+
+        while (top > 0)
+        {
+            const OctreeNode& node = nodes[stack[--top]];
+            glm::vec3 outside = glm::max(glm::abs(node.center - p) - glm::vec3(node.halfSize), glm::vec3(0.0f));
+            if (glm::dot(outside, outside) >= rcut2)
+                continue;
+
+            glm::vec3 d = node.com - p;
+            float d2 = glm::dot(d, d);
+
+            if (d2 > node.openRadius2)
+            {
+                if (d2 < rcut2)
+                {
+                    float invR = 1.0f / std::sqrt(d2 + eps2);
+                    acc += d * (node.mass * invR * invR * invR * gravityScreen(screening.force, screening, d2));
+                    if (useQuadrupole)
+                    {
+                        // the single-cell run of the group walk's screened quadrupole kernel
+                        const GravityScreenedCells cell = { &node.com.x, &node.com.y, &node.com.z,
+                            { &node.quad[0], &node.quad[1], &node.quad[2], &node.quad[3], &node.quad[4], &node.quad[5] }, &node.spread, 1 };
+                        float quad[3];
+                        gravityShortRangeQuadrupoleKernelScalar(cell, screening, p.x, p.y, p.z, eps2, quad);
+                        acc += glm::vec3(quad[0], quad[1], quad[2]);
+                    }
+                }
+            }
+            else if (node.firstChild < 0)
+            {
+                for (unsigned int k = node.begin; k < node.end; k++)
+                {
+                    unsigned int j = index[k];
+                    glm::vec3 dj(x[j] - p.x, y[j] - p.y, z[j] - p.z);
+                    float dj2 = glm::dot(dj, dj);
+                    if (j == self || dj2 >= rcut2)
+                        continue;
+                    float invR = 1.0f / std::sqrt(dj2 + eps2);
+                    acc += dj * (m[j] * invR * invR * invR * gravityScreen(screening.force, screening, dj2));
+                }
+            }
+            else
+            {
+                for (int c = 0; c < node.childCount; c++)
+                    stack[top++] = node.firstChild + c;
+            }
+        }
+        return acc;
+    }
+
+    // errorTolerance |a_old| in tree units for target i; 0 = use theta
+    float errorLimit(const ParticleStore& particles, size_t i) const
+    {
+        if (errorTolerance <= 0.0f || i >= particles.size())
+            return 0.0f;
+        return errorTolerance * glm::length(particles.acceleration(i)) / accelerationScale;
+    }
+
+    // opening test: d2 is the squared distance to the com, offset the target
+    // (or the bucket's box point nearest the centre) minus the cell centre
+    bool accepts(const OctreeNode& node, const glm::vec3& offset, float d2, float limit) const
+    {
+        return accepts(node.mass, node.halfSize, node.openRadius2, offset, d2, limit);
+    }
+
+    bool accepts(float mass, float halfSize, float openRadius2, const glm::vec3& offset, float d2, float limit) const
+    {
+        if (limit <= 0.0f)
+            return d2 > openRadius2;
+        glm::vec3 o = glm::abs(offset);
+        if (std::max(o.x, std::max(o.y, o.z)) < 1.2f * halfSize)
+            return false;
+        // M l^p / r^(p+2) <= limit, without divisions
+        float l = 2.0f * halfSize;
+        float term = mass * l * l, bound = limit * d2 * d2;
+        if (useQuadrupole)
+        {
+            term *= l;
+            bound *= std::sqrt(d2);
+        }
+        return term <= bound;
+    }
+
+    // monopole + quadrupole field of a cell; d points from the target to the com
+    glm::vec3 cellAcceleration(const OctreeNode& node, const glm::vec3& d, float d2, float eps2) const
+    {
+        float r2 = d2 + eps2;
+        float invR = 1.0f / std::sqrt(r2);
+        float invR2 = invR * invR;
+        float invR3 = invR * invR2;
+        glm::vec3 acc = d * (node.mass * invR3);
+        if (useQuadrupole)
+            acc += quadrupoleAcceleration(node, d, invR2, invR3 * invR2);
+        return acc;
+    }
+
+    // with r = target - com = -d:  a = Q.r / r^5 - 5/2 (r.Q.r) r / r^7
+    static glm::vec3 quadrupoleAcceleration(const OctreeNode& node, const glm::vec3& d, float invR2, float invR5)
+    {
+        const float* q = node.quad;
+        glm::vec3 qd(q[0] * d.x + q[1] * d.y + q[2] * d.z,
+                     q[1] * d.x + q[3] * d.y + q[4] * d.z,
+                     q[2] * d.x + q[4] * d.y + q[5] * d.z);
+        float dqd = glm::dot(d, qd);
+        return -qd * invR5 + d * (2.5f * dqd * invR5 * invR2);
+    }
+
+    // quadrupole field of the cell's images one box away across the faces
+    // the com is far from (d is the nearest image); up to seven of them
+    glm::vec3 imageQuadrupoles(const OctreeNode& node, const glm::vec3& d, float eps2) const
+    {
+        const float quarter = 0.25f * boxSize;
+        int faces = 0;
+        for (int k = 0; k < 3; k++)
+            faces |= std::abs(d[k]) > quarter ? 1 << k : 0;
+
+        glm::vec3 acc(0.0f);
+        for (int s = faces; s > 0; s = (s - 1) & faces)
+        {
+            glm::vec3 di = d;
+            for (int k = 0; k < 3; k++)
+            {
+                if (s & (1 << k))
+                    di[k] -= d[k] > 0.0f ? boxSize : -boxSize;
+            }
+            float invR = 1.0f / std::sqrt(glm::dot(di, di) + eps2);
+            float invR2 = invR * invR;
+            acc += quadrupoleAcceleration(node, di, invR2, invR2 * invR2 * invR);
+        }
+        return acc;
+    }
+
+    // the build proper, see build()
+    void buildTree(const ParticleStore& particles)
+    {
+        const size_t n = particles.size();
+        index.resize(n);
+        scratch.resize(n);
+        std::iota(index.begin(), index.end(), 0u);
+        nodes.clear();
+        if (n == 0)
+            return;
+        nodes.reserve(2 * n / leafSize + 16);
+
+        typedef std::pair<glm::vec3, glm::vec3> Bounds;
+        Bounds box = parallelReduce(0, n, Bounds(particles.position(0), particles.position(0)),
+            [&](size_t b, size_t e)
+            {
+                Bounds chunk(particles.position(b), particles.position(b));
+                for (size_t i = b + 1; i < e; i++)
+                {
+                    glm::vec3 p = particles.position(i);
+                    chunk.first = glm::min(chunk.first, p);
+                    chunk.second = glm::max(chunk.second, p);
+                }
+                return chunk;
+            },
+            [](const Bounds& a, const Bounds& b) { return Bounds(glm::min(a.first, b.first), glm::max(a.second, b.second)); },
+            4096);
+        const glm::vec3 lo = box.first, hi = box.second;
+        glm::vec3 extent = hi - lo;
+        float half = 0.5f * std::max(extent.x, std::max(extent.y, extent.z));
+        half = half * 1.0001f + 1e-6f;
+
+        prepareScreening();
+
+        OctreeNode root{};
+        root.center = 0.5f * (lo + hi);
+        root.halfSize = half;
+        root.begin = 0;
+        root.end = (unsigned int)n;
+        nodes.push_back(root);
+
+        if (threadPool().size() == 1 || n < 4096)
+            buildNode(nodes, 0, 0, particles);
+        else
+            buildParallel(particles);
+    }
+
+    // Split the top of the tree serially until there are a few subtrees per
+    // thread, build those in parallel into private node arrays, then splice
+    // them in and finish the moments of the shared top levels bottom-up.
+    // Subtrees own disjoint ranges of index/scratch, so they never collide.
+    void buildParallel(const ParticleStore& particles)
+    {
+        const size_t target = 8 * threadPool().size();
+        std::vector<std::pair<int, int>> frontier(1, std::make_pair(0, 0)); // node, depth
+        for (int level = 0; level < 6 && frontier.size() < target; level++)
+        {
+            std::vector<std::pair<int, int>> next;
+            bool split = false;
+            for (const std::pair<int, int>& f : frontier)
+            {
+                const OctreeNode& node = nodes[f.first];
+                if (node.end - node.begin <= 4 * leafSize || f.second >= maxDepth)
+                {
+                    next.push_back(f);
+                    continue;
+                }
+                int childCount = splitNode(nodes, f.first, particles);
+                for (int c = 0; c < childCount; c++)
+                    next.push_back(std::make_pair(nodes[f.first].firstChild + c, f.second + 1));
+                split = true;
+            }
+            frontier.swap(next);
+            if (!split)
+                break;
+        }
+
+        const size_t topCount = nodes.size();
+        std::vector<std::vector<OctreeNode>> subtrees(frontier.size());
+        parallelFor(0, frontier.size(), [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                std::vector<OctreeNode>& local = subtrees[k];
+                const OctreeNode& root = nodes[frontier[k].first];
+                local.reserve(2 * (root.end - root.begin) / leafSize + 1);
+                local.push_back(root);
+                buildNode(local, 0, frontier[k].second, particles);
+            }
+        }, 1);
+
+        // local node 0 is the frontier node itself, local node j > 0 lands at base + j - 1
+        std::vector<char> isFrontier(topCount, 0);
+        for (size_t k = 0; k < frontier.size(); k++)
+        {
+            std::vector<OctreeNode>& local = subtrees[k];
+            const int base = (int)nodes.size();
+            for (OctreeNode& node : local)
+            {
+                if (node.firstChild > 0)
+                    node.firstChild += base - 1;
+            }
+            nodes[frontier[k].first] = local[0];
+            nodes.insert(nodes.end(), local.begin() + 1, local.end());
+            isFrontier[frontier[k].first] = 1;
+        }
+
+        // top-level children always come after their parent
+        for (size_t i = topCount; i-- > 0;)
+        {
+            if (!isFrontier[i])
+                nodeMoments(nodes, nodes[i]);
+        }
+    }
+
+    // counting sort of a node's range into octants, appending its non-empty
+    // children next to each other; returns the child count
+    int splitNode(std::vector<OctreeNode>& out, int ni, const ParticleStore& particles)
+    {
+        const unsigned int begin = out[ni].begin;
+        const unsigned int end = out[ni].end;
+
+        const glm::vec3 c = out[ni].center;
+        unsigned int count[8] = { 0 };
+        for (unsigned int k = begin; k < end; k++)
+            count[octant(particles.position(index[k]), c)]++;
+
+        unsigned int offset[8];
+        unsigned int running = begin;
+        for (int o = 0; o < 8; o++)
+        {
+            offset[o] = running;
+            running += count[o];
+        }
+        unsigned int cursor[8];
+        std::copy(offset, offset + 8, cursor);
+        for (unsigned int k = begin; k < end; k++)
+        {
+            unsigned int i = index[k];
+            scratch[cursor[octant(particles.position(i), c)]++] = i;
+        }
+        std::copy(scratch.begin() + begin, scratch.begin() + end, index.begin() + begin);
+
+        // allocate the non-empty children next to each other
+        const float childHalf = 0.5f * out[ni].halfSize;
+        const int first = (int)out.size();
+        for (int o = 0; o < 8; o++)
+        {
+            if (count[o] == 0)
+                continue;
+            OctreeNode child{};
+            child.center = c + childHalf * glm::vec3((o & 1) ? 1.0f : -1.0f,
+                                                     (o & 2) ? 1.0f : -1.0f,
+                                                     (o & 4) ? 1.0f : -1.0f);
+            child.halfSize = childHalf;
+            child.begin = offset[o];
+            child.end = offset[o] + count[o];
+            out.push_back(child);
+        }
+        const int childCount = (int)out.size() - first;
+        out[ni].firstChild = first;
+        out[ni].childCount = childCount;
+        return childCount;
+    }
+
+    void buildNode(std::vector<OctreeNode>& out, int ni, int depth, const ParticleStore& particles)
+    {
+        if (out[ni].end - out[ni].begin <= leafSize || depth >= maxDepth)
+        {
+            out[ni].firstChild = -1;
+            out[ni].childCount = 0;
+            leafMoments(out[ni], particles);
+            return;
+        }
+
+        const int childCount = splitNode(out, ni, particles);
+        const int first = out[ni].firstChild;
+        for (int k = 0; k < childCount; k++)
+            buildNode(out, first + k, depth + 1, particles);
+
+        nodeMoments(out, out[ni]);
+    }
+
+    static int octant(const glm::vec3& p, const glm::vec3& c)
+    {
+        return (p.x >= c.x ? 1 : 0) | (p.y >= c.y ? 2 : 0) | (p.z >= c.z ? 4 : 0);
+    }
+
+    static void addPointQuadrupole(float* q, const glm::vec3& d, float m)
+    {
+        float d2 = glm::dot(d, d);
+        q[0] += m * (3.0f * d.x * d.x - d2);
+        q[1] += m * (3.0f * d.x * d.y);
+        q[2] += m * (3.0f * d.x * d.z);
+        q[3] += m * (3.0f * d.y * d.y - d2);
+        q[4] += m * (3.0f * d.y * d.z);
+        q[5] += m * (3.0f * d.z * d.z - d2);
+    }
+
+    void leafMoments(OctreeNode& node, const ParticleStore& particles) const
+    {
+        float m = 0.0f;
+        glm::vec3 com(0.0f);
+        for (unsigned int k = node.begin; k < node.end; k++)
+        {
+            unsigned int i = index[k];
+            m += particles.mass[i];
+            com += particles.mass[i] * particles.position(i);
+        }
+        node.mass = m;
+        node.com = m > 0.0f ? com / m : node.center;
+
+        std::fill(node.quad, node.quad + 6, 0.0f);
+        node.spread = 0.0f;
+        for (unsigned int k = node.begin; k < node.end; k++)
+        {
+            unsigned int i = index[k];
+            glm::vec3 d = particles.position(i) - node.com;
+            addPointQuadrupole(node.quad, d, particles.mass[i]);
+            node.spread += particles.mass[i] * glm::dot(d, d);
+        }
+        setOpenRadius(node);
+    }
+
+    // 'all' is the array holding the node's children, the tree's own or a subtree's
+    void nodeMoments(const std::vector<OctreeNode>& all, OctreeNode& node) const
+    {
+        float m = 0.0f;
+        glm::vec3 com(0.0f);
+        for (int c = 0; c < node.childCount; c++)
+        {
+            const OctreeNode& child = all[node.firstChild + c];
+            m += child.mass;
+            com += child.mass * child.com;
+        }
+        node.mass = m;
+        node.com = m > 0.0f ? com / m : node.center;
+
+        // parallel axis theorem: shift each child's quadrupole to the parent com
+        std::fill(node.quad, node.quad + 6, 0.0f);
+        node.spread = 0.0f;
+        for (int c = 0; c < node.childCount; c++)
+        {
+            const OctreeNode& child = all[node.firstChild + c];
+            glm::vec3 d = child.com - node.com;
+            for (int k = 0; k < 6; k++)
+                node.quad[k] += child.quad[k];
+            addPointQuadrupole(node.quad, d, child.mass);
+            node.spread += child.spread + child.mass * glm::dot(d, d);
+        }
+        setOpenRadius(node);
+    }
+
+    // Barnes' modified criterion: accept when d > l / theta + |com - center|,
+    // which stays safe when the com sits near a cell corner
+    void setOpenRadius(OctreeNode& node) const
+    {
+        if (theta <= 0.0f)
+        {
+            node.openRadius2 = 3.0e38f;
+            return;
+        }
+        float r = 2.0f * node.halfSize / theta + glm::length(node.com - node.center);
+        node.openRadius2 = r * r;
+    }
+};
+#endif
@@ -0,0 +1,432 @@
+#ifndef PARTICLE_MESH_H
+#define PARTICLE_MESH_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+#include "FFT.h"
+
+enum class MassAssignment
+{
+    CIC, // cloud-in-cell, 2^3 cells per particle
+    TSC  // triangular-shaped cloud, 3^3 cells, smoother and less anisotropic
+};
+
+// Particle-mesh gravity with isolated boundaries (Hockney & Eastwood). Mass
+// is assigned to an n^3 mesh, which sits in one octant of a zero-padded
+// (2n)^3 grid so the FFT convolution with the softened Green's function
+// does not wrap. The potential is differenced on the mesh (4-point stencil)
+// and the field is interpolated back with the same assignment kernel, so
+// there is no self-force.
+//
+// The mesh is a cube over the particles' bounding box with its cell size
+// rounded up to a power of two, so the transformed Green's function can be
+// reused for many steps. A few far outliers stretch the box and cost
+// resolution for everyone; PM only resolves forces on scales of a few cells.
+class ParticleMesh
+{
+public:
+    int gridSize = 128;                         // cells per side, a power of two
+    MassAssignment assignment = MassAssignment::TSC;
+
+    // TreePM long-range mode: with splitCells > 0 only the erf part of the
+    // potential, smooth on rs = splitCells cells, is solved on the mesh and the
+    // assignment window is deconvolved; the tree adds the rest (see TreePM.h)
+    float splitCells = 0.0f;
+
+    // per-phase times of the last evaluation, in seconds
+    struct Timings
+    {
+        double deposit = 0.0, fft = 0.0, gradient = 0.0, interpolate = 0.0;
+    } timings;
+
+    // accelerations (without G) for every particle into ax/ay/az
+    // ------------------------------------------------------------------------
+    void accelerations(ParticleStore& p, float softening)
+    {
+        solve(p, softening);
+        interpolate(p, nullptr, p.size());
+    }
+
+    // same, only for the listed targets; the mesh still holds everyone's mass
+    void accelerations(ParticleStore& p, float softening, const std::vector<uint32_t>& targets)
+    {
+        solve(p, softening);
+        interpolate(p, targets.data(), targets.size());
+    }
+
+    float cellSize() const
+    {
+        return h;
+    }
+
+    // rs of the last solve in length units, 0 without a split
+    float splitRadius() const
+    {
+        return splitCells * h;
+    }
+
+    // nearest power of two in [8, 512]; the (2n)^3 padded grid at 512 is already 4 GB
+    static int roundGridSize(int n)
+    {
+        int size = 8;
+        while (size < n && size < 512)
+            size *= 2;
+        return size;
+    }
+
+private:
+    // FFT grid (2n)^3 with padded rows; first the mass, then the potential
+    std::vector<float> grid;
+    RealFFT3D fft;
+    std::vector<float> greenHat;          // real spectrum of the Green's function
+    int greenSize = 0;
+    float greenCell = 0.0f, greenSoftening = 0.0f, greenSplit = 0.0f;
+    MassAssignment greenAssignment = MassAssignment::CIC;
+
+    std::vector<float> fieldX, fieldY, fieldZ; // -grad(phi) on the n^3 mesh
+    std::vector<uint32_t> binned, stripeStart;
+
+    glm::vec3 origin = glm::vec3(0.0f);
+    float h = 1.0f;
+
+    static const int STRIPE = 4; // mesh slabs per deposition stripe
+
+    typedef std::chrono::steady_clock Clock;
+    static double since(Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    size_t paddedIndex(int x, int y, int z) const
+    {
+        const size_t m = 2 * (size_t)gridSize;
+        return ((size_t)z * m + (size_t)y) * (m + 2) + (size_t)x;
+    }
+
+    size_t meshIndex(int x, int y, int z) const
+    {
+        return ((size_t)z * gridSize + (size_t)y) * gridSize + (size_t)x;
+    }
+
+    // particle position in cell units, cell centres at integers
+    glm::vec3 cellCoordinate(const ParticleStore& p, size_t i) const
+    {
+        return (p.position(i) - origin) / h;
+    }
+
+    // 1D weights and first cell of the assignment kernel
+    int weights(float u, float w[3]) const
+    {
+        if (assignment == MassAssignment::CIC)
+        {
+            int i = (int)std::floor(u);
+            float d = u - i;
+            w[0] = 1.0f - d;
+            w[1] = d;
+            w[2] = 0.0f;
+            return i;
+        }
+        int i = (int)std::floor(u + 0.5f);
+        float d = u - i;
+        w[0] = 0.5f * (0.5f - d) * (0.5f - d);
+        w[1] = 0.75f - d * d;
+        w[2] = 0.5f * (0.5f + d) * (0.5f + d);
+        return i - 1;
+    }
+
+    // ------------------------------------------------------------------------
+    void solve(ParticleStore& p, float softening)
+    {
+        const int n = gridSize;
+        const size_t m = 2 * (size_t)n;
+        if (fft.size() != m)
+        {
+            fft = RealFFT3D(m);
+            grid.assign(fft.floatCount(), 0.0f);
+            greenSize = 0;
+        }
+
+        placeMesh(p);
+
+        auto start = Clock::now();
+        deposit(p);
+        timings.deposit = since(start);
+
+        start = Clock::now();
+        float eps = std::max(softening, 0.5f * h);
+        if (greenSize != n || greenCell != h || greenSoftening != eps || greenSplit != splitCells || greenAssignment != assignment)
+            buildGreen(eps);
+
+        fft.forward(grid.data(), n);
+        const size_t complexCount = (m / 2 + 1) * m * m;
+        Complex* c = reinterpret_cast<Complex*>(grid.data());
+        parallelFor(0, complexCount, [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+                c[k] *= greenHat[k];
+        }, 16384);
+        fft.inverse(grid.data(), n);
+        timings.fft = since(start);
+
+        start = Clock::now();
+        differentiate();
+        timings.gradient = since(start);
+    }
+
+    // cube over the bounding box, cell size rounded up to a power of two, with
+    // particles kept in [3, n - 5] in cell units: the kernel then touches cells
+    // 2..n-3 and their gradient stencils stay inside the mesh
+    void placeMesh(const ParticleStore& p)
+    {
+        typedef std::pair<glm::vec3, glm::vec3> Bounds;
+        const size_t count = p.size();
+        Bounds box = count == 0 ? Bounds(glm::vec3(0.0f), glm::vec3(0.0f)) :
+            parallelReduce(0, count, Bounds(p.position(0), p.position(0)),
+            [&](size_t b, size_t e)
+            {
+                Bounds chunk(p.position(b), p.position(b));
+                for (size_t i = b + 1; i < e; i++)
+                {
+                    chunk.first = glm::min(chunk.first, p.position(i));
+                    chunk.second = glm::max(chunk.second, p.position(i));
+                }
+                return chunk;
+            },
+            [](const Bounds& a, const Bounds& b) { return Bounds(glm::min(a.first, b.first), glm::max(a.second, b.second)); },
+            4096);
+
+        glm::vec3 extent = box.second - box.first;
+        float size = std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+        h = std::exp2(std::ceil(std::log2(size / (float)(gridSize - 8))));
+        origin = 0.5f * (box.first + box.second) - glm::vec3(0.5f * h * (gridSize - 2));
+    }
+
+    // Mass onto the mesh, in parallel without atomics: particles are binned
+    // into x stripes STRIPE slabs wide, a particle only touches its own
+    // stripe and one slab either side, so all even stripes can be filled at
+    // once, then all odd ones.
+    void deposit(const ParticleStore& p)
+    {
+        const size_t count = p.size();
+        const int n = gridSize;
+        const int stripes = (n + STRIPE - 1) / STRIPE;
+        std::fill(grid.begin(), grid.end(), 0.0f);
+
+        // counting sort of particle indices by stripe
+        std::vector<uint32_t> stripeOf(count);
+        parallelFor(0, count, [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+            {
+                int x = (int)std::floor(cellCoordinate(p, i).x);
+                stripeOf[i] = (uint32_t)std::min(std::max(x / STRIPE, 0), stripes - 1);
+            }
+        }, 16384);
+        stripeStart.assign(stripes + 1, 0);
+        for (size_t i = 0; i < count; i++)
+            stripeStart[stripeOf[i] + 1]++;
+        for (int s = 0; s < stripes; s++)
+            stripeStart[s + 1] += stripeStart[s];
+        binned.resize(count);
+        std::vector<uint32_t> cursor(stripeStart.begin(), stripeStart.end() - 1);
+        for (size_t i = 0; i < count; i++)
+            binned[cursor[stripeOf[i]]++] = (uint32_t)i;
+
+        for (int colour = 0; colour < 2; colour++)
+        {
+            parallelFor(0, (size_t)(stripes + 1) / 2, [&](size_t b, size_t e)
+            {
+                for (size_t k = b; k < e; k++)
+                {
+                    int s = 2 * (int)k + colour;
+                    if (s >= stripes)
+                        continue;
+                    for (uint32_t q = stripeStart[s]; q < stripeStart[s + 1]; q++)
+                        depositParticle(p, binned[q]);
+                }
+            }, 1);
+        }
+    }
+
+    void depositParticle(const ParticleStore& p, uint32_t i)
+    {
+        const int n = gridSize;
+        glm::vec3 u = cellCoordinate(p, i);
+        float wx[3], wy[3], wz[3];
+        int x0 = weights(u.x, wx), y0 = weights(u.y, wy), z0 = weights(u.z, wz);
+        const int span = assignment == MassAssignment::CIC ? 2 : 3;
+        const float m = p.mass[i];
+        for (int c = 0; c < span; c++)
+        {
+            int z = z0 + c;
+            if (z < 0 || z >= n)
+                continue;
+            for (int b = 0; b < span; b++)
+            {
+                int y = y0 + b;
+                if (y < 0 || y >= n)
+                    continue;
+                float wyz = m * wy[b] * wz[c];
+                for (int a = 0; a < span; a++)
+                {
+                    int x = x0 + a;
+                    if (x >= 0 && x < n)
+                        grid[paddedIndex(x, y, z)] += wyz * wx[a];
+                }
+            }
+        }
+    }
+
+    // softened -1/r sampled on the doubled grid with its periodic images
+    // folded back, transformed once and kept while the cell size holds. With a
+    // split it is -erf(r / 2rs) / r instead, which needs no softening
+    void buildGreen(float eps)
+    {
+        const int m = 2 * gridSize;
+        const float rs = splitRadius();
+        std::vector<float> g(fft.floatCount(), 0.0f);
+        parallelFor(0, (size_t)m, [&](size_t b, size_t e)
+        {
+            for (size_t zz = b; zz < e; zz++)
+            {
+                int z = (int)zz;
+                float dz = (float)std::min(z, m - z) * h;
+                for (int y = 0; y < m; y++)
+                {
+                    float dy = (float)std::min(y, m - y) * h;
+                    for (int x = 0; x < m; x++)
+                    {
+                        float dx = (float)std::min(x, m - x) * h;
+                        if (rs > 0.0f)
+                        {
+                            float r = std::sqrt(dx * dx + dy * dy + dz * dz);
+                            g[paddedIndex(x, y, z)] = r > 0.0f ? -std::erf(r / (2.0f * rs)) / r
+                                : -1.0f / (rs * std::sqrt(3.14159265f));
+                        }
+                        else
+                            g[paddedIndex(x, y, z)] = -1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + eps * eps);
+                    }
+                }
+            }
+        }, 1);
+        fft.forward(g.data());
+
+        // the kernel is real and even, so its spectrum is real; fold in the 1/m^3 of the inverse
+        const size_t complexCount = (size_t)(m / 2 + 1) * m * m;
+        const float norm = 1.0f / ((float)m * m * m);
+        greenHat.resize(complexCount);
+        for (size_t k = 0; k < complexCount; k++)
+            greenHat[k] = g[2 * k] * norm;
+
+        // Deposit and interpolation each smooth by the assignment window W(k);
+        // the split kernel is already cut off below a couple of cells, so
+        // dividing by W^2 restores the long-range force without blowing up noise
+        if (rs > 0.0f)
+        {
+            const int power = assignment == MassAssignment::CIC ? 4 : 6;
+            std::vector<float> window(m);
+            for (int k = 0; k < m; k++)
+            {
+                float s = 3.14159265f * (float)std::min(k, m - k) / (float)m;
+                window[k] = k == 0 ? 1.0f : std::pow(std::sin(s) / s, (float)power);
+            }
+            const int kx = m / 2 + 1;
+            for (size_t k = 0; k < complexCount; k++)
+                greenHat[k] /= window[k % kx] * window[(k / kx) % m] * window[k / ((size_t)kx * m)];
+        }
+
+        greenSize = gridSize;
+        greenCell = h;
+        greenSoftening = eps;
+        greenSplit = splitCells;
+        greenAssignment = assignment;
+    }
+
+    // field = -grad(phi) with the 4-point central difference, on the cells
+    // 2..n-3 that particles can reach; the border stays zero
+    void differentiate()
+    {
+        const int n = gridSize;
+        const size_t cells = (size_t)n * n * n;
+        fieldX.assign(cells, 0.0f);
+        fieldY.assign(cells, 0.0f);
+        fieldZ.assign(cells, 0.0f);
+
+        auto phi = [&](int x, int y, int z)
+        {
+            return grid[paddedIndex(x, y, z)];
+        };
+        const float scale = 1.0f / (12.0f * h);
+
+        parallelFor(2, (size_t)n - 2, [&](size_t b, size_t e)
+        {
+            for (size_t zz = b; zz < e; zz++)
+            {
+                int z = (int)zz;
+                for (int y = 2; y < n - 2; y++)
+                {
+                    for (int x = 2; x < n - 2; x++)
+                    {
+                        size_t k = meshIndex(x, y, z);
+                        fieldX[k] = -scale * (8.0f * (phi(x + 1, y, z) - phi(x - 1, y, z)) - (phi(x + 2, y, z) - phi(x - 2, y, z)));
+                        fieldY[k] = -scale * (8.0f * (phi(x, y + 1, z) - phi(x, y - 1, z)) - (phi(x, y + 2, z) - phi(x, y - 2, z)));
+                        fieldZ[k] = -scale * (8.0f * (phi(x, y, z + 1) - phi(x, y, z - 1)) - (phi(x, y, z + 2) - phi(x, y, z - 2)));
+                    }
+                }
+            }
+        }, 1);
+    }
+
+    // field back to particles with the assignment kernel; targets == nullptr means everyone
+    void interpolate(ParticleStore& p, const uint32_t* targets, size_t count)
+    {
+        auto start = Clock::now();
+        const int n = gridSize;
+        const int span = assignment == MassAssignment::CIC ? 2 : 3;
+        parallelFor(0, count, [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                uint32_t i = targets ? targets[k] : (uint32_t)k;
+                glm::vec3 u = cellCoordinate(p, i);
+                float wx[3], wy[3], wz[3];
+                int x0 = weights(u.x, wx), y0 = weights(u.y, wy), z0 = weights(u.z, wz);
+                glm::vec3 acc(0.0f);
+                for (int c = 0; c < span; c++)
+                {
+                    int z = z0 + c;
+                    if (z < 0 || z >= n)
+                        continue;
+                    for (int bb = 0; bb < span; bb++)
+                    {
+                        int y = y0 + bb;
+                        if (y < 0 || y >= n)
+                            continue;
+                        for (int a = 0; a < span; a++)
+                        {
+                            int x = x0 + a;
+                            if (x < 0 || x >= n)
+                                continue;
+                            size_t cell = meshIndex(x, y, z);
+                            float w = wx[a] * wy[bb] * wz[c];
+                            acc += w * glm::vec3(fieldX[cell], fieldY[cell], fieldZ[cell]);
+                        }
+                    }
+                }
+                p.setAcceleration(i, acc);
+            }
+        }, 4096);
+        timings.interpolate = since(start);
+    }
+};
+#endif
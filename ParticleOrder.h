@@ -0,0 +1,166 @@
+#ifndef PARTICLE_ORDER_H
+#define PARTICLE_ORDER_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <utility>
+#include <numeric>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+// Space-filling-curve ordering. Particles are sorted along a Morton
+// (Z-order) curve so bodies that are close in space are close in memory;
+// tree leaves then cover contiguous runs of the columns and walks for
+// neighbouring targets touch the same cache lines.
+
+// spread the low 21 bits of v so there are two zero bits between each
+// ------------------------------------------------------------------------
+inline uint64_t mortonSpread21(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+
+// 63-bit key from three 21-bit cell coordinates
+inline uint64_t mortonKey(uint32_t ix, uint32_t iy, uint32_t iz)
+{
+    return mortonSpread21(ix) | mortonSpread21(iy) << 1 | mortonSpread21(iz) << 2;
+}
+
+// keys on a 2^21 grid over the bounding cube of the particles
+// ------------------------------------------------------------------------
+inline void mortonKeys(const ParticleStore& p, std::vector<uint64_t>& keys)
+{
+    const size_t n = p.size();
+    keys.resize(n);
+    if (n == 0)
+        return;
+
+    typedef std::pair<glm::vec3, glm::vec3> Bounds;
+    Bounds box = parallelReduce(0, n, Bounds(p.position(0), p.position(0)),
+        [&](size_t b, size_t e)
+        {
+            Bounds chunk(p.position(b), p.position(b));
+            for (size_t i = b + 1; i < e; i++)
+            {
+                chunk.first = glm::min(chunk.first, p.position(i));
+                chunk.second = glm::max(chunk.second, p.position(i));
+            }
+            return chunk;
+        },
+        [](const Bounds& a, const Bounds& b) { return Bounds(glm::min(a.first, b.first), glm::max(a.second, b.second)); },
+        4096);
+
+    // a cube rather than the box itself, so cells stay cubic and the curve isotropic
+    glm::vec3 extent = box.second - box.first;
+    float size = std::max(extent.x, std::max(extent.y, extent.z));
+    const float cells = (float)((1u << 21) - 1);
+    const float scale = size > 0.0f ? cells / size : 0.0f;
+    const glm::vec3 lo = box.first;
+
+    parallelFor(0, n, [&](size_t b, size_t e)
+    {
+        for (size_t i = b; i < e; i++)
+        {
+            glm::vec3 q = glm::clamp((p.position(i) - lo) * scale, glm::vec3(0.0f), glm::vec3(cells));
+            keys[i] = mortonKey((uint32_t)q.x, (uint32_t)q.y, (uint32_t)q.z);
+        }
+    }, 4096);
+}
+
+// Stable LSD radix sort of keys, 8 bits per pass, carrying a permutation
+// along: afterwards keys are ascending and order[i] is the original index of
+// the i-th key. Each pass histograms fixed chunks in parallel, turns the
+// histograms into per-chunk write offsets, then scatters the chunks in
+// parallel; passes whose digit is the same for every key are skipped.
+// ------------------------------------------------------------------------
+inline void radixSort(std::vector<uint64_t>& keys, std::vector<uint32_t>& order)
+{
+    const size_t n = keys.size();
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0u);
+    if (n < 2)
+        return;
+
+    const size_t chunks = std::max<size_t>(1, std::min<size_t>(4 * threadPool().size(), n / 16384));
+    const size_t chunkSize = (n + chunks - 1) / chunks;
+    std::vector<uint64_t> keysOut(n);
+    std::vector<uint32_t> orderOut(n);
+    std::vector<size_t> histogram(chunks * 256);
+
+    for (int shift = 0; shift < 64; shift += 8)
+    {
+        std::fill(histogram.begin(), histogram.end(), 0);
+        parallelFor(0, chunks, [&](size_t c0, size_t c1)
+        {
+            for (size_t c = c0; c < c1; c++)
+            {
+                size_t* h = &histogram[c * 256];
+                for (size_t i = c * chunkSize, e = std::min(n, (c + 1) * chunkSize); i < e; i++)
+                    h[(keys[i] >> shift) & 0xff]++;
+            }
+        }, 1);
+
+        // digit-major prefix sum: all of digit 0 (chunk by chunk), then digit 1, ...
+        size_t running = 0;
+        bool trivial = false;
+        for (int d = 0; d < 256; d++)
+        {
+            size_t total = 0;
+            for (size_t c = 0; c < chunks; c++)
+            {
+                size_t count = histogram[c * 256 + d];
+                histogram[c * 256 + d] = running;
+                running += count;
+                total += count;
+            }
+            trivial |= total == n;
+        }
+        if (trivial)
+            continue;
+
+        parallelFor(0, chunks, [&](size_t c0, size_t c1)
+        {
+            for (size_t c = c0; c < c1; c++)
+            {
+                size_t* offset = &histogram[c * 256];
+                for (size_t i = c * chunkSize, e = std::min(n, (c + 1) * chunkSize); i < e; i++)
+                {
+                    size_t dst = offset[(keys[i] >> shift) & 0xff]++;
+                    keysOut[dst] = keys[i];
+                    orderOut[dst] = order[i];
+                }
+            }
+        }, 1);
+        keys.swap(keysOut);
+        order.swap(orderOut);
+    }
+}
+
+// Sorts every particle column along the Morton curve. keys/order are
+// scratch buffers the caller can keep around between calls.
+// ------------------------------------------------------------------------
+inline void mortonReorder(ParticleStore& p, std::vector<uint64_t>& keys, std::vector<uint32_t>& order)
+{
+    mortonKeys(p, keys);
+    radixSort(keys, order);
+    p.permute(order);
+}
+
+inline void mortonReorder(ParticleStore& p)
+{
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> order;
+    mortonReorder(p, keys, order);
+}
+#endif
@@ -0,0 +1,168 @@
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "ThreadPool.h"
+
+// std::vector allocator that hands out 64-byte aligned storage, so every
+// column starts on a cache line and full-width SIMD loads never split one
+// ------------------------------------------------------------------------
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+    }
+
+    void deallocate(T* p, size_t)
+    {
+        ::operator delete(p, std::align_val_t(Alignment));
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Structure-of-arrays particle storage. Each attribute is its own aligned
+// column, so force kernels stream x/y/z/mass with unit stride and the
+// renderer can upload a column without repacking.
+class ParticleStore
+{
+public:
+    AlignedVector<float> x, y, z;
+    AlignedVector<float> vx, vy, vz;
+    AlignedVector<float> ax, ay, az;
+    AlignedVector<float> mass;
+    AlignedVector<uint32_t> id;
+
+    // block timestep state: level l steps with dt / 2^l, jerk is the last
+    // |da/dt| estimate used by the timestep criterion
+    AlignedVector<uint8_t> level;
+    AlignedVector<float> jerk;
+
+    // da/dt, only maintained by the Hermite integrator
+    AlignedVector<float> jx, jy, jz;
+
+    // gas bodies (gas != 0) also carry SPH state: smoothing length h,
+    // density, specific internal energy u and du/dt (see SPH.h); zero for stars
+    AlignedVector<uint8_t> gas;
+    AlignedVector<float> smoothing, density, energy, energyRate;
+
+    size_t size() const
+    {
+        return x.size();
+    }
+
+    size_t capacity() const
+    {
+        return x.capacity();
+    }
+
+    bool empty() const
+    {
+        return x.empty();
+    }
+
+    // bulk operations apply to every column
+    // ------------------------------------------------------------------------
+    void reserve(size_t n)
+    {
+        forEachColumn([n](auto& column) { column.reserve(n); });
+    }
+
+    // new particles are zeroed and receive fresh ids
+    void resize(size_t n)
+    {
+        size_t old = size();
+        forEachColumn([n](auto& column) { column.resize(n); });
+        for (size_t i = old; i < n; i++)
+            id[i] = nextId++;
+    }
+
+    void clear()
+    {
+        forEachColumn([](auto& column) { column.clear(); });
+        nextId = 0;
+    }
+
+    size_t add(const glm::vec3& pos, const glm::vec3& vel, float m)
+    {
+        size_t i = size();
+        resize(i + 1);
+        setPosition(i, pos);
+        setVelocity(i, vel);
+        mass[i] = m;
+        return i;
+    }
+
+    // new[i] = old[order[i]] for every column, forces included so a pending
+    // kick stays valid; order must be a permutation of 0..size()-1
+    // ------------------------------------------------------------------------
+    void permute(const std::vector<uint32_t>& order)
+    {
+        forEachColumn([&order](auto& column)
+        {
+            typename std::remove_reference<decltype(column)>::type sorted(column.size());
+            parallelFor(0, column.size(), [&](size_t b, size_t e)
+            {
+                for (size_t i = b; i < e; i++)
+                    sorted[i] = column[order[i]];
+            }, 16384);
+            column.swap(sorted);
+        });
+    }
+
+    // per-particle accessors
+    // ------------------------------------------------------------------------
+    glm::vec3 position(size_t i) const { return glm::vec3(x[i], y[i], z[i]); }
+    glm::vec3 velocity(size_t i) const { return glm::vec3(vx[i], vy[i], vz[i]); }
+    glm::vec3 acceleration(size_t i) const { return glm::vec3(ax[i], ay[i], az[i]); }
+
+    void setPosition(size_t i, const glm::vec3& p) { x[i] = p.x; y[i] = p.y; z[i] = p.z; }
+    void setVelocity(size_t i, const glm::vec3& v) { vx[i] = v.x; vy[i] = v.y; vz[i] = v.z; }
+    void setAcceleration(size_t i, const glm::vec3& a) { ax[i] = a.x; ay[i] = a.y; az[i] = a.z; }
+
+    template <typename F>
+    void forEachColumn(F&& f)
+    {
+        f(x); f(y); f(z);
+        f(vx); f(vy); f(vz);
+        f(ax); f(ay); f(az);
+        f(mass);
+        f(id);
+        f(level);
+        f(jerk);
+        f(jx); f(jy); f(jz);
+        f(gas);
+        f(smoothing); f(density); f(energy); f(energyRate);
+    }
+
+private:
+    uint32_t nextId = 0;
+};
+#endif
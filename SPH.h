@@ -0,0 +1,530 @@
+#ifndef SPH_H
+#define SPH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+#include "Ewald.h"
+
+// Smoothed particle hydrodynamics for the gas bodies (ParticleStore::gas):
+// the "grad-h" formulation (Springel & Hernquist 2002) evolving the internal
+// energy, with the cubic spline kernel (support 2h) and an ideal gas,
+// P = (gamma - 1) rho u:
+//   rho_i   = sum_j m_j W(r_ij, h_i), with h_i = eta (m_i / rho_i)^(1/3)
+//   dv_i/dt = -sum_j m_j (f_i P_i / rho_i^2 gradW(h_i) + f_j P_j / rho_j^2 gradW(h_j) + Pi_ij gradW_ij)
+//   du_i/dt =  sum_j m_j (f_i P_i / rho_i^2 gradW(h_i) + Pi_ij gradW_ij / 2) . v_ij
+// f_i = 1 / (1 + h_i / (3 rho_i) drho_i/dh_i) accounts for h varying with
+// density, and Pi_ij is the signal velocity viscosity of GADGET-2
+// (Monaghan 1997), switched on for approaching pairs only. Total energy,
+// kinetic plus thermal, is conserved pair by pair.
+//
+// Neighbours come from a uniform cell list: every evaluation copies the gas
+// into cell order (counting sort on the cell index), so a body's neighbours
+// sit in a few contiguous runs of memory, and each body searches just the
+// cells its own sphere overlaps, which keeps adaptive h exact without a
+// global search radius. Periodic boxes wrap the cell range.
+// ------------------------------------------------------------------------
+class SPH
+{
+public:
+    float gamma = 5.0f / 3.0f; // adiabatic index
+    float eta = 1.2f;          // h = eta (m / rho)^(1/3), about 58 neighbours within 2h
+    float viscosity = 1.0f;    // alpha of the viscosity, 0 = none
+    float courant = 0.3f;      // stable step is courant * h / v_sig
+
+    // last evaluation
+    size_t gasCount = 0;
+    glm::ivec3 dims = glm::ivec3(0);
+    double buildSeconds = 0.0;   // gathering the gas into cell order
+    double densitySeconds = 0.0; // neighbour gather and smoothing length iteration
+    double forceSeconds = 0.0;
+    double meanNeighbours = 0.0; // within 2h
+    double meanIterations = 0.0; // density evaluations per body to converge h
+    float courantStep = 0.0f;    // smallest courant * h / v_sig over the gas
+
+    // Density, smoothing lengths, hydro accelerations (kept here until
+    // addAccelerations) and du/dt of every gas body. Velocities and energies
+    // are first predicted `ahead` in time with the last accelerations and
+    // rates, as the kick-drift-kick leapfrog evaluates forces half a kick
+    // after its velocities.
+    // ------------------------------------------------------------------------
+    void compute(ParticleStore& p, float boxSize, float ahead)
+    {
+        auto start = std::chrono::steady_clock::now();
+        build(p, boxSize, ahead);
+        buildSeconds = secondsSince(start);
+        if (gasCount == 0)
+            return;
+
+        start = std::chrono::steady_clock::now();
+        densities();
+        densitySeconds = secondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        forces();
+        forceSeconds = secondsSince(start);
+
+        for (size_t k = 0; k < gasCount; k++)
+        {
+            uint32_t i = gasIndex[k];
+            p.smoothing[i] = h[k];
+            p.density[i] = rho[k];
+            p.energyRate[i] = du[k];
+        }
+    }
+
+    // add the hydro accelerations of the last compute to ax/ay/az
+    void addAccelerations(ParticleStore& p) const
+    {
+        parallelFor(0, gasCount, [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                uint32_t i = gasIndex[k];
+                p.ax[i] += ax[k];
+                p.ay[i] += ay[k];
+                p.az[i] += az[k];
+            }
+        }, 16384);
+    }
+
+    // Neighbour search alone, for benchmarks: builds the cell list and counts
+    // the bodies within 2h of every gas body at the stored smoothing lengths.
+    unsigned long long countNeighbours(const ParticleStore& p, float boxSize)
+    {
+        build(p, boxSize, 0.0f);
+        return parallelReduce(0, gasCount, 0ull, [&](size_t b, size_t e)
+        {
+            unsigned long long count = 0;
+            for (size_t i = b; i < e; i++)
+            {
+                const glm::vec3 pos(x[i], y[i], z[i]);
+                const float radius = 2.0f * h[i], r2Max = radius * radius;
+                visitCells(pos, radius, [&](const CellVisit& cell)
+                {
+                    if (cell.d2 > r2Max)
+                        return;
+                    for (uint32_t j = cell.begin; j < cell.end; j++)
+                    {
+                        glm::vec3 d = delta(cell, j, pos);
+                        count += glm::dot(d, d) < r2Max;
+                    }
+                });
+            }
+            return count;
+        }, [](unsigned long long a, unsigned long long b) { return a + b; }, 256);
+    }
+
+    // cubic spline, W = sigma / h^3 kernel(q) with q = r / h
+    static float kernel(float q)
+    {
+        if (q < 1.0f)
+            return 1.0f - 1.5f * q * q + 0.75f * q * q * q;
+        if (q < 2.0f)
+        {
+            float t = 2.0f - q;
+            return 0.25f * t * t * t;
+        }
+        return 0.0f;
+    }
+
+    // dkernel/dq
+    static float kernelSlope(float q)
+    {
+        if (q < 1.0f)
+            return q * (-3.0f + 2.25f * q);
+        if (q < 2.0f)
+        {
+            float t = 2.0f - q;
+            return -0.75f * t * t;
+        }
+        return 0.0f;
+    }
+
+private:
+    static constexpr float sigma = 0.318309886f; // 1 / pi, 3D normalisation
+
+    // gas in cell order, indexed by k; gasIndex[k] is the store index
+    std::vector<uint32_t> gasIndex, cellOf, sortedIndex;
+    AlignedVector<float> x, y, z, vx, vy, vz, m, h, u;
+    AlignedVector<float> rho, factor, c; // factor = f P / rho^2, c = sound speed
+    AlignedVector<float> ax, ay, az, du;
+
+    // cell list: cellStart[c] .. cellStart[c + 1] are the bodies of cell c (x fastest)
+    std::vector<uint32_t> cellStart;
+    std::vector<float> cellMaxH;
+    float maxH = 0.0f;
+    glm::vec3 origin = glm::vec3(0.0f), cellSize = glm::vec3(1.0f);
+    float box = 0.0f; // > 0: periodic
+
+    struct CellVisit
+    {
+        uint32_t begin, end;
+        uint32_t cell;
+        glm::vec3 shift;   // periodic image offset of the cell's bodies
+        glm::bvec3 whole;  // the range covered the box on this axis: minimum image per pair
+        float d2;          // squared distance from the searching body to the cell
+    };
+
+    static double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // separation from pos to body j of the visited cell
+    glm::vec3 delta(const CellVisit& cell, uint32_t j, const glm::vec3& pos) const
+    {
+        glm::vec3 d(x[j] + cell.shift.x - pos.x, y[j] + cell.shift.y - pos.y, z[j] + cell.shift.z - pos.z);
+        if (cell.whole.x) d.x = periodicDelta(d.x, box);
+        if (cell.whole.y) d.y = periodicDelta(d.y, box);
+        if (cell.whole.z) d.z = periodicDelta(d.z, box);
+        return d;
+    }
+
+    // every cell overlapping the cube of half side radius around pos, with the
+    // distance to its box so callers can prune by their own radius
+    // ------------------------------------------------------------------------
+    template <typename F>
+    void visitCells(const glm::vec3& pos, float radius, F&& visit) const
+    {
+        glm::ivec3 lo, hi;
+        glm::bvec3 whole(false);
+        for (int a = 0; a < 3; a++)
+        {
+            lo[a] = (int)std::floor((pos[a] - radius - origin[a]) / cellSize[a]);
+            hi[a] = (int)std::floor((pos[a] + radius - origin[a]) / cellSize[a]);
+            if (box > 0.0f && hi[a] - lo[a] + 1 >= dims[a])
+            {
+                lo[a] = 0;
+                hi[a] = dims[a] - 1;
+                whole[a] = true;
+            }
+            else if (box <= 0.0f)
+            {
+                lo[a] = std::max(lo[a], 0);
+                hi[a] = std::min(hi[a], dims[a] - 1);
+            }
+        }
+
+        CellVisit cell;
+        cell.whole = whole;
+        for (int kz = lo.z; kz <= hi.z; kz++)
+        {
+            int cz = wrap(kz, dims.z, cell.shift.z);
+            float dz = whole.z ? 0.0f : gap(pos.z, origin.z + kz * cellSize.z, cellSize.z);
+            for (int ky = lo.y; ky <= hi.y; ky++)
+            {
+                int cy = wrap(ky, dims.y, cell.shift.y);
+                float dy = whole.y ? 0.0f : gap(pos.y, origin.y + ky * cellSize.y, cellSize.y);
+                for (int kx = lo.x; kx <= hi.x; kx++)
+                {
+                    int cx = wrap(kx, dims.x, cell.shift.x);
+                    float dx = whole.x ? 0.0f : gap(pos.x, origin.x + kx * cellSize.x, cellSize.x);
+                    cell.cell = ((uint32_t)cz * dims.y + cy) * dims.x + cx;
+                    cell.begin = cellStart[cell.cell];
+                    cell.end = cellStart[cell.cell + 1];
+                    cell.d2 = dx * dx + dy * dy + dz * dz;
+                    if (cell.begin != cell.end)
+                        visit(cell);
+                }
+            }
+        }
+    }
+
+    // cell k of a periodic range folded into 0..n-1, with the offset that
+    // brings its bodies next to the searching one
+    int wrap(int k, int n, float& shift) const
+    {
+        int w = k % n;
+        if (w < 0)
+            w += n;
+        shift = (float)((k - w) / n) * box;
+        return w;
+    }
+
+    // distance from v to the interval [lo, lo + size]
+    static float gap(float v, float lo, float size)
+    {
+        return std::max(std::max(lo - v, v - lo - size), 0.0f);
+    }
+
+    // gather the gas into cell order, with predicted velocities and energies
+    // ------------------------------------------------------------------------
+    void build(const ParticleStore& p, float boxSize, float ahead)
+    {
+        box = boxSize;
+        gasIndex.clear();
+        for (size_t i = 0; i < p.size(); i++)
+        {
+            if (p.gas[i])
+                gasIndex.push_back((uint32_t)i);
+        }
+        const size_t n = gasCount = gasIndex.size();
+        if (n == 0)
+        {
+            dims = glm::ivec3(0);
+            return;
+        }
+
+        glm::vec3 lo(0.0f), hi(boxSize);
+        if (box <= 0.0f)
+        {
+            lo = hi = p.position(gasIndex[0]);
+            for (uint32_t i : gasIndex)
+            {
+                lo = glm::min(lo, p.position(i));
+                hi = glm::max(hi, p.position(i));
+            }
+            glm::vec3 pad = 1e-4f * glm::max(hi - lo, glm::vec3(1e-6f));
+            lo -= pad;
+            hi += pad;
+        }
+        const glm::vec3 extent = glm::max(hi - lo, glm::vec3(1e-6f));
+
+        // bodies without a smoothing length yet start at the mean spacing
+        const float volume = extent.x * extent.y * extent.z;
+        const float start = eta * std::cbrt(volume / n);
+        double sum = 0.0;
+        for (uint32_t i : gasIndex)
+            sum += p.smoothing[i] > 0.0f ? p.smoothing[i] : start;
+
+        // cells about one mean kernel support across, at most two per body
+        const float side = 2.0f * (float)(sum / n);
+        for (int a = 0; a < 3; a++)
+            dims[a] = std::max(1, std::min((int)(extent[a] / side), 1024));
+        const double limit = 2.0 * n + 8.0;
+        double cells = (double)dims.x * dims.y * dims.z;
+        if (cells > limit)
+        {
+            double shrink = std::cbrt(cells / limit);
+            for (int a = 0; a < 3; a++)
+                dims[a] = std::max(1, (int)(dims[a] / shrink));
+        }
+        origin = lo;
+        cellSize = extent / glm::vec3(dims);
+        const size_t cellCount = (size_t)dims.x * dims.y * dims.z;
+
+        // counting sort on the cell index
+        cellOf.resize(n);
+        cellStart.assign(cellCount + 1, 0);
+        for (size_t k = 0; k < n; k++)
+        {
+            glm::ivec3 c = glm::ivec3((p.position(gasIndex[k]) - origin) / cellSize);
+            c = glm::clamp(c, glm::ivec3(0), dims - 1);
+            cellOf[k] = ((uint32_t)c.z * dims.y + c.y) * dims.x + c.x;
+            cellStart[cellOf[k] + 1]++;
+        }
+        for (size_t c = 0; c < cellCount; c++)
+            cellStart[c + 1] += cellStart[c];
+        sortedIndex.resize(n);
+        {
+            std::vector<uint32_t> next(cellStart.begin(), cellStart.end() - 1);
+            for (size_t k = 0; k < n; k++)
+                sortedIndex[next[cellOf[k]]++] = gasIndex[k];
+        }
+        gasIndex.swap(sortedIndex);
+
+        for (AlignedVector<float>* column : { &x, &y, &z, &vx, &vy, &vz, &m, &h, &u, &rho, &factor, &c, &ax, &ay, &az, &du })
+            column->resize(n);
+        parallelFor(0, n, [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                uint32_t i = gasIndex[k];
+                x[k] = p.x[i];
+                y[k] = p.y[i];
+                z[k] = p.z[i];
+                vx[k] = p.vx[i] + p.ax[i] * ahead;
+                vy[k] = p.vy[i] + p.ay[i] * ahead;
+                vz[k] = p.vz[i] + p.az[i] * ahead;
+                m[k] = p.mass[i];
+                h[k] = p.smoothing[i] > 0.0f ? p.smoothing[i] : start;
+                u[k] = std::max(p.energy[i] + p.energyRate[i] * ahead, 0.0f);
+            }
+        }, 16384);
+    }
+
+    // Density of every body, iterating h_i with Newton's method on
+    // rho(h) = m (eta / h)^3. Candidates within 2h of a slightly larger h are
+    // gathered once and reused by the iterations; only a body whose h grows
+    // past them searches again.
+    // ------------------------------------------------------------------------
+    void densities()
+    {
+        const float maxSmoothing = box > 0.0f ? 0.25f * box : 3.0e38f;
+        typedef std::pair<unsigned long long, unsigned long long> Counts; // neighbours, iterations
+        Counts counts = parallelReduce(0, gasCount, Counts(0, 0), [&](size_t b, size_t e)
+        {
+            Counts chunk(0, 0);
+            std::vector<uint32_t> near;
+            std::vector<float> nearR2;
+            for (size_t i = b; i < e; i++)
+            {
+                const glm::vec3 pos(x[i], y[i], z[i]);
+                const float target = m[i] * eta * eta * eta;
+                float hi = h[i], reach = 0.0f;
+                float density = 0.0f, slope = 0.0f;
+                unsigned int neighbours = 0;
+                for (int iteration = 0; iteration < 40; iteration++)
+                {
+                    if (2.0f * hi > reach)
+                    {
+                        reach = 2.5f * hi;
+                        const float r2Max = reach * reach;
+                        near.clear();
+                        nearR2.clear();
+                        visitCells(pos, reach, [&](const CellVisit& cell)
+                        {
+                            if (cell.d2 > r2Max)
+                                return;
+                            for (uint32_t j = cell.begin; j < cell.end; j++)
+                            {
+                                glm::vec3 d = delta(cell, j, pos);
+                                float r2 = glm::dot(d, d);
+                                if (r2 < r2Max)
+                                {
+                                    near.push_back(j);
+                                    nearR2.push_back(r2);
+                                }
+                            }
+                        });
+                    }
+
+                    const float invH = 1.0f / hi, r2Max = 4.0f * hi * hi;
+                    density = slope = 0.0f;
+                    neighbours = 0;
+                    for (size_t n = 0; n < near.size(); n++)
+                    {
+                        if (nearR2[n] >= r2Max)
+                            continue;
+                        float q = std::sqrt(nearR2[n]) * invH;
+                        float w = kernel(q);
+                        density += m[near[n]] * w;
+                        slope += m[near[n]] * (3.0f * w + q * kernelSlope(q));
+                        neighbours++;
+                    }
+                    const float invH3 = invH * invH * invH;
+                    density *= sigma * invH3;
+                    slope *= -sigma * invH3 * invH;
+                    chunk.second++;
+
+                    // f(h) = rho(h) - m eta^3 / h^3, falling back to the fixed point if f' isn't positive
+                    const float wanted = target * invH3;
+                    const float derivative = slope + 3.0f * wanted * invH;
+                    float next = derivative > 0.0f ? hi - (density - wanted) / derivative
+                        : eta * std::cbrt(m[i] / density);
+                    next = std::min(std::max(next, 0.7f * hi), 1.5f * hi);
+                    next = std::min(next, maxSmoothing);
+                    if (std::abs(next - hi) < 1e-3f * hi)
+                        break;
+                    hi = next;
+                }
+
+                float omega = 1.0f + hi / (3.0f * density) * slope;
+                if (omega < 0.1f)
+                    omega = 1.0f;
+                const float pressure = (gamma - 1.0f) * density * u[i];
+                h[i] = hi;
+                rho[i] = density;
+                factor[i] = pressure / (omega * density * density);
+                c[i] = std::sqrt(gamma * (gamma - 1.0f) * u[i]);
+                chunk.first += neighbours;
+            }
+            return chunk;
+        },
+        [](const Counts& a, const Counts& b) { return Counts(a.first + b.first, a.second + b.second); },
+        256);
+
+        meanNeighbours = (double)counts.first / gasCount;
+        meanIterations = (double)counts.second / gasCount;
+
+        const size_t cellCount = cellStart.size() - 1;
+        cellMaxH.assign(cellCount, 0.0f);
+        maxH = 0.0f;
+        for (size_t cell = 0; cell < cellCount; cell++)
+        {
+            for (uint32_t k = cellStart[cell]; k < cellStart[cell + 1]; k++)
+                cellMaxH[cell] = std::max(cellMaxH[cell], h[k]);
+            maxH = std::max(maxH, cellMaxH[cell]);
+        }
+    }
+
+    // Pressure and viscous accelerations and du/dt. A pair interacts if either
+    // body's kernel reaches the other, so each body searches out to the
+    // largest h around and skips the cells whose own largest h can't reach.
+    // ------------------------------------------------------------------------
+    void forces()
+    {
+        const float alpha = viscosity;
+        courantStep = parallelReduce(0, gasCount, 3.0e38f, [&](size_t b, size_t e)
+        {
+            float step = 3.0e38f;
+            for (size_t i = b; i < e; i++)
+            {
+                const glm::vec3 pos(x[i], y[i], z[i]);
+                const float hi = h[i], invHi = 1.0f / hi;
+                const float scaleI = sigma * invHi * invHi * invHi * invHi * invHi;
+                glm::vec3 acc(0.0f);
+                float rate = 0.0f, signal = c[i];
+
+                visitCells(pos, 2.0f * std::max(hi, maxH), [&](const CellVisit& cell)
+                {
+                    const float reach = 2.0f * std::max(hi, cellMaxH[cell.cell]);
+                    if (cell.d2 >= reach * reach)
+                        return;
+                    for (uint32_t j = cell.begin; j < cell.end; j++)
+                    {
+                        if (j == i)
+                            continue;
+                        const glm::vec3 d = -delta(cell, j, pos); // x_i - x_j
+                        const float r2 = glm::dot(d, d), hj = h[j];
+                        if (r2 >= 4.0f * hi * hi && r2 >= 4.0f * hj * hj)
+                            continue;
+                        const float r = std::sqrt(r2);
+                        if (r == 0.0f)
+                            continue;
+
+                        // gradW(h) = sigma / h^5 kernel'(q) / q (x_i - x_j)
+                        const float invHj = 1.0f / hj;
+                        const float qi = r * invHi, qj = r * invHj;
+                        const float gi = scaleI * kernelSlope(qi) / qi;
+                        const float gj = sigma * invHj * invHj * invHj * invHj * invHj * kernelSlope(qj) / qj;
+
+                        const glm::vec3 dv(vx[i] - vx[j], vy[i] - vy[j], vz[i] - vz[j]);
+                        const float approach = glm::dot(dv, d);
+                        float viscous = 0.0f, vsig = c[i] + c[j];
+                        if (approach < 0.0f)
+                        {
+                            const float w = approach / r;
+                            vsig -= 3.0f * w;
+                            viscous = -alpha * vsig * w / (rho[i] + rho[j]);
+                        }
+                        signal = std::max(signal, vsig);
+
+                        const float mean = 0.5f * (gi + gj);
+                        acc -= m[j] * (factor[i] * gi + factor[j] * gj + viscous * mean) * d;
+                        rate += m[j] * (factor[i] * gi + 0.5f * viscous * mean) * approach;
+                    }
+                });
+
+                ax[i] = acc.x;
+                ay[i] = acc.y;
+                az[i] = acc.z;
+                du[i] = rate;
+                if (signal > 0.0f)
+                    step = std::min(step, courant * hi / signal);
+            }
+            return step;
+        }, [](float a, float b) { return std::min(a, b); }, 256);
+    }
+};
+#endif
@@ -7,10 +7,13 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <string>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#include "FrameUniforms.h"
+
 class Shader
 {
 public:
@@ -70,6 +73,11 @@ public:
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        // 3. look up every active uniform once and attach the shared per-frame block
+        cacheUniformLocations();
+        GLuint frameBlock = glGetUniformBlockIndex(ID, "FrameData");
+        if (frameBlock != GL_INVALID_INDEX)
+            glUniformBlockBinding(ID, frameBlock, FRAME_DATA_BINDING);
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -77,38 +85,99 @@ public:
     {
         glUseProgram(ID);
     }
-    // utility uniform functions
+    // location of an active uniform from the cache filled at link time,
+    // -1 (ignored by glUniform*) if the program has no such uniform
+    // ------------------------------------------------------------------------
+    GLint uniformLocation(const std::string& name) const
+    {
+        auto it = uniformLocations.find(name);
+        return it != uniformLocations.end() ? it->second : -1;
+    }
+    // utility uniform functions, by name (cache lookup, no driver call)
     // ------------------------------------------------------------------------
     void setBool(const std::string& name, bool value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+        setBool(uniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string& name, int value) const
     {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        setInt(uniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string& name, float value) const
     {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        setFloat(uniformLocation(name), value);
     }
-    void setMat4(const std::string& name, glm::mat4 value) const
+    void setMat4(const std::string& name, const glm::mat4& value) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+        setMat4(uniformLocation(name), value);
     }
 
     void setVec3(const std::string& name, const glm::vec3& value) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec3(uniformLocation(name), value);
     }
 
     void setVec2(const std::string& name, const glm::vec2& value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+        setVec2(uniformLocation(name), value);
+    }
+    // utility uniform functions, by location from uniformLocation(); use these in per-frame code
+    // ------------------------------------------------------------------------
+    void setBool(GLint location, bool value) const
+    {
+        glUniform1i(location, (int)value);
+    }
+    void setInt(GLint location, int value) const
+    {
+        glUniform1i(location, value);
+    }
+    void setFloat(GLint location, float value) const
+    {
+        glUniform1f(location, value);
+    }
+    void setMat4(GLint location, const glm::mat4& value) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+    void setVec3(GLint location, const glm::vec3& value) const
+    {
+        glUniform3fv(location, 1, &value[0]);
+    }
+    void setVec2(GLint location, const glm::vec2& value) const
+    {
+        glUniform2fv(location, 1, &value[0]);
     }
 
 private:
+    std::unordered_map<std::string, GLint> uniformLocations;
+
+    // enumerate the program's active uniforms; arrays are stored under both
+    // "name" and "name[0]" since either spelling is valid in glGetUniformLocation
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type = 0;
+            glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, &name[0]);
+            std::string uniform(name.c_str(), length);
+            GLint location = glGetUniformLocation(ID, uniform.c_str());
+            if (location < 0)
+                continue; // members of uniform blocks have no location
+            uniformLocations[uniform] = location;
+            if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+                uniformLocations[uniform.substr(0, uniform.size() - 3)] = location;
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
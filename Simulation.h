@@ -0,0 +1,745 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include "ParticleStore.h"
+#include "Gravity.h"
+#include "Octree.h"
+#include "ThreadPool.h"
+#include "ParticleOrder.h"
+#include "ParticleMesh.h"
+#include "TreePM.h"
+#include "FMM.h"
+#include "Cosmology.h"
+#include "SPH.h"
+
+enum class ForceSolver
+{
+    Direct,    // exact O(N^2) pair sum
+    BarnesHut, // O(N log N) octree, accuracy set by tree.theta
+    ParticleMesh, // FFT on a mesh, O(N + M log M), smoothed below a few cells (mesh.gridSize)
+    TreePM,    // mesh for the long range, tree within a cutoff (treePM.splitCells)
+    FMM        // O(N) dual-tree fast multipole, accuracy set by fmm.order and fmm.theta
+};
+
+inline const char* forceSolverName(ForceSolver solver)
+{
+    switch (solver)
+    {
+    case ForceSolver::BarnesHut: return "Barnes-Hut";
+    case ForceSolver::ParticleMesh: return "particle-mesh";
+    case ForceSolver::TreePM: return "TreePM";
+    case ForceSolver::FMM: return "FMM";
+    default: return "direct summation";
+    }
+}
+
+// "direct", "tree", "pm", "treepm" or "fmm"; anything else is direct
+inline ForceSolver parseForceSolver(const std::string& name)
+{
+    if (name == "tree")
+        return ForceSolver::BarnesHut;
+    if (name == "pm")
+        return ForceSolver::ParticleMesh;
+    if (name == "treepm")
+        return ForceSolver::TreePM;
+    if (name == "fmm")
+        return ForceSolver::FMM;
+    return ForceSolver::Direct;
+}
+
+enum class Integrator
+{
+    Leapfrog, // kick-drift-kick, second order, works with every solver
+    Hermite   // fourth order predictor-corrector, direct summation only
+};
+
+// Gravitational N-body system advanced with a kick-drift-kick leapfrog
+// (or a Hermite scheme, see Integrator).
+// Units are arbitrary simulation units; G defaults to 1.
+class Simulation
+{
+public:
+    ParticleStore particles;
+
+    float G;         // gravitational constant
+    float softening; // Plummer softening length, keeps close encounters finite
+    float timeStep;  // fixed integration step
+
+    ForceSolver solver = ForceSolver::Direct;
+    Integrator integrator = Integrator::Leapfrog;
+    Octree tree;
+    ParticleMesh mesh;
+    TreePM treePM;
+    FastMultipole fmm;
+
+    // Periodic boundaries: with boxSize > 0 bodies live in the cube
+    // [0, boxSize)^3, are wrapped back into it after every drift, and feel
+    // all periodic images through Ewald corrections (Ewald.h). Supported by
+    // the direct and Barnes-Hut solvers with the leapfrog; the others
+    // ignore it.
+    float boxSize = 0.0f;
+
+    // Comoving integration (GADGET-2): positions are comoving, vx/vy/vz hold
+    // the canonical momentum per unit mass w = a^2 dx/dt (the Hubble drag is
+    // built into it, the peculiar velocity is w / a), and each step advances
+    // ln(a) by timeStep; time still counts cosmic time. Kick and drift
+    // factors come from CosmologyTables, so a step costs what a static one
+    // does. Meant for periodic boxes, where the Ewald sum removes the mean
+    // density; always uses global leapfrog steps.
+    bool comoving = false;
+    Cosmology cosmology;
+    double scaleFactor = 1.0;
+
+    // Gas: bodies added with addGas also feel SPH pressure forces and carry
+    // an internal energy (SPH.h). Hydrodynamics runs with the global
+    // leapfrog in static coordinates only: with gas, Hermite and block
+    // timesteps fall back to it (see runsHermite, runsBlockSteps), and
+    // comoving steps treat gas as plain bodies. gravity = false drops the
+    // gravitational forces altogether, for pure hydrodynamics tests.
+    SPH sph;
+    bool gravity = true;
+
+    // sort the particles along a Morton curve every this many steps, 0 = never;
+    // particle indices change, ParticleStore::id stays with the body
+    unsigned int reorderInterval = 32;
+
+    // Hierarchical block timesteps (leapfrog only): each body steps with timeStep / 2^level,
+    // the level picked from its acceleration and jerk at the start of each of
+    // its own steps. Only bodies whose step ends get new forces.
+    bool blockTimesteps = false;
+    int maxLevel = 8;             // finest step is timeStep / 2^maxLevel
+    float timestepEta = 0.025f;   // dt <= sqrt(2 eta softening / |a|)
+    float jerkEta = 0.1f;         // dt <= jerkEta |a| / |da/dt|
+
+    // block timestep statistics of the last step (all 1 for global steps)
+    unsigned int forceEvaluations = 1; // substeps that had active bodies
+    double activeFraction = 1.0;       // mean share of bodies active per evaluation
+    double workFraction = 1.0;         // body-evaluations relative to everyone at the finest level used
+    double evaluationsPerBody = 1.0;   // body-evaluations per body, a global step does 1
+
+    double time = 0.0;
+    unsigned long long stepCount = 0;
+
+    Simulation(float timeStep = 0.01f, float softening = 0.05f, float G = 1.0f)
+        : G(G), softening(softening), timeStep(timeStep)
+    {
+    }
+
+    size_t size() const
+    {
+        return particles.size();
+    }
+
+    void clear()
+    {
+        particles.clear();
+        gasBodies = 0;
+        forcesValid = jerksValid = false;
+    }
+
+    size_t gasCount() const
+    {
+        return gasBodies;
+    }
+
+    // the scheme step() actually takes, after the fallbacks for comoving runs and gas
+    bool runsHermite() const
+    {
+        return integrator == Integrator::Hermite && !comoving && !hydrodynamics();
+    }
+
+    bool runsBlockSteps() const
+    {
+        return !runsHermite() && blockTimesteps && !comoving && !hydrodynamics();
+    }
+
+    void addBody(const glm::vec3& pos, const glm::vec3& vel, float m)
+    {
+        particles.add(pos, vel, m);
+        forcesValid = jerksValid = false;
+    }
+
+    // gas body with specific internal energy u; its smoothing length is found on the first step
+    void addGas(const glm::vec3& pos, const glm::vec3& vel, float m, float u)
+    {
+        size_t i = particles.add(pos, vel, m);
+        particles.gas[i] = 1;
+        particles.energy[i] = u;
+        gasBodies++;
+        forcesValid = jerksValid = false;
+    }
+
+    // advance the system by one fixed timestep
+    // ------------------------------------------------------------------------
+    void step()
+    {
+        // bodies drift apart in memory as they move, pull them back into curve order
+        if (reorderInterval > 0 && stepCount % reorderInterval == 0)
+        {
+            mortonReorder(particles, reorderKeys, reorderOrder);
+            tree.remap(reorderOrder);
+            treePM.tree.remap(reorderOrder);
+        }
+
+        const bool hydro = hydrodynamics();
+        if (runsHermite())
+        {
+            hermiteStep();
+            forceEvaluations = 1;
+            activeFraction = workFraction = evaluationsPerBody = 1.0;
+            time += timeStep;
+            stepCount++;
+            return;
+        }
+
+        // leapfrog needs a(t) at the start of the step; only computed once
+        // after the particle set changes, every later step reuses the last kick's forces
+        if (!forcesValid)
+            computeForces();
+
+        if (runsBlockSteps())
+        {
+            blockStep();
+            time += timeStep;
+            stepCount++;
+            return;
+        }
+
+        // static: half kicks and the drift are plain time intervals
+        float kickIn = 0.5f * timeStep, drift = timeStep, kickOut = 0.5f * timeStep;
+        double elapsed = timeStep;
+        if (comoving)
+        {
+            const double a0 = scaleFactor, a2 = scaleFactor * std::exp((double)timeStep);
+            const double a1 = std::sqrt(a0 * a2);
+            if (!cosmologyTables.covers(cosmology, a0, a2))
+                cosmologyTables.build(cosmology, a0 / 4.0, a2 * 64.0);
+            kickIn = (float)cosmologyTables.kick(a0, a1);
+            drift = (float)cosmologyTables.drift(a0, a2);
+            kickOut = (float)cosmologyTables.kick(a1, a2);
+            elapsed = cosmologyTables.time(a0, a2);
+            scaleFactor = a2;
+        }
+        const size_t n = size();
+        ParticleStore& p = particles;
+
+        // kick (half step) + drift (full step)
+        parallelFor(0, n, [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+            {
+                p.vx[i] += p.ax[i] * kickIn;
+                p.vy[i] += p.ay[i] * kickIn;
+                p.vz[i] += p.az[i] * kickIn;
+                p.x[i] += p.vx[i] * drift;
+                p.y[i] += p.vy[i] * drift;
+                p.z[i] += p.vz[i] * drift;
+            }
+        }, 16384);
+        wrapPositions();
+        if (hydro)
+            kickEnergies(kickIn);
+
+        // the velocities lag by kickOut, the gas predicts them forward
+        computeForces(kickOut);
+
+        // kick (half step) with the new forces
+        parallelFor(0, n, [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+            {
+                p.vx[i] += p.ax[i] * kickOut;
+                p.vy[i] += p.ay[i] * kickOut;
+                p.vz[i] += p.az[i] * kickOut;
+            }
+        }, 16384);
+        if (hydro)
+            kickEnergies(kickOut);
+
+        forceEvaluations = 1;
+        activeFraction = workFraction = evaluationsPerBody = 1.0;
+        time += elapsed;
+        stepCount++;
+    }
+
+    // Evaluate accelerations at the current positions with the selected
+    // solver, plus the SPH forces on the gas. `ahead` is how far the
+    // velocities lag the positions (half a kick inside a leapfrog step).
+    // ------------------------------------------------------------------------
+    void computeForces(float ahead = 0.0f)
+    {
+        const bool hydro = hydrodynamics();
+        if (hydro)
+            sph.compute(particles, boxSize, ahead);
+        if (!gravity)
+        {
+            particles.ax.assign(size(), 0.0f);
+            particles.ay.assign(size(), 0.0f);
+            particles.az.assign(size(), 0.0f);
+            if (hydro)
+                sph.addAccelerations(particles);
+            jerksValid = false;
+            forcesValid = true;
+            return;
+        }
+
+        tree.accelerationScale = G;
+        tree.boxSize = boxSize;
+        switch (solver)
+        {
+        case ForceSolver::BarnesHut:
+            tree.accelerations(particles, softening);
+            break;
+        case ForceSolver::ParticleMesh:
+            mesh.accelerations(particles, softening);
+            break;
+        case ForceSolver::TreePM:
+            treePM.accelerations(particles, softening);
+            break;
+        case ForceSolver::FMM:
+            fmm.accelerations(particles, softening);
+            break;
+        default:
+            if (boxSize > 0.0f)
+                periodicDirectAccelerations(particles, softening, boxSize);
+            else
+                directAccelerations(particles, softening);
+            break;
+        }
+        jerksValid = false;
+
+        parallelFor(0, size(), [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+            {
+                particles.ax[i] *= G;
+                particles.ay[i] *= G;
+                particles.az[i] *= G;
+            }
+        }, 16384);
+        if (hydro)
+            sph.addAccelerations(particles);
+
+        forcesValid = true;
+    }
+
+    // accelerations for the listed bodies only; the rest keep theirs
+    // ------------------------------------------------------------------------
+    void computeForces(const std::vector<uint32_t>& targets)
+    {
+        // block steps never run with gas, so there is no SPH to add here
+        if (!gravity)
+        {
+            for (uint32_t i : targets)
+                particles.setAcceleration(i, glm::vec3(0.0f));
+            jerksValid = false;
+            return;
+        }
+
+        tree.accelerationScale = G;
+        tree.boxSize = boxSize;
+        switch (solver)
+        {
+        case ForceSolver::BarnesHut:
+            tree.accelerations(particles, softening, targets);
+            break;
+        case ForceSolver::ParticleMesh:
+            mesh.accelerations(particles, softening, targets);
+            break;
+        case ForceSolver::TreePM:
+            treePM.accelerations(particles, softening, targets);
+            break;
+        case ForceSolver::FMM:
+            fmm.accelerations(particles, softening, targets);
+            break;
+        default:
+            if (boxSize > 0.0f)
+                periodicDirectAccelerations(particles, softening, boxSize, targets);
+            else
+                directAccelerations(particles, softening, targets);
+            break;
+        }
+        jerksValid = false;
+
+        parallelFor(0, targets.size(), [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                uint32_t i = targets[k];
+                particles.ax[i] *= G;
+                particles.ay[i] *= G;
+                particles.az[i] *= G;
+            }
+        }, 4096);
+    }
+
+    // diagnostics
+    // ------------------------------------------------------------------------
+    double kineticEnergy() const
+    {
+        return parallelReduce(0, size(), 0.0, [this](size_t b, size_t e)
+        {
+            double sum = 0.0;
+            for (size_t i = b; i < e; i++)
+            {
+                glm::vec3 v = particles.velocity(i);
+                sum += 0.5 * particles.mass[i] * glm::dot(v, v);
+            }
+            return sum;
+        }, [](double a, double b) { return a + b; }, 16384);
+    }
+
+    // sum of m u over the gas
+    double thermalEnergy() const
+    {
+        if (gasBodies == 0)
+            return 0.0;
+        return parallelReduce(0, size(), 0.0, [this](size_t b, size_t e)
+        {
+            double sum = 0.0;
+            for (size_t i = b; i < e; i++)
+                sum += particles.gas[i] ? (double)particles.mass[i] * particles.energy[i] : 0.0;
+            return sum;
+        }, [](double a, double b) { return a + b; }, 16384);
+    }
+
+    double potentialEnergy() const
+    {
+        if (!gravity)
+            return 0.0;
+        // rows get shorter with i, so use small chunks and let stealing balance them
+        const double eps2 = (double)softening * softening;
+        const EwaldTable* table = boxSize > 0.0f ? &ewaldTable() : nullptr;
+        double e = parallelReduce(0, size(), 0.0, [&](size_t b, size_t end)
+        {
+            double sum = 0.0;
+            for (size_t i = b; i < end; i++)
+            {
+                const double mi = particles.mass[i];
+                // periodic: each body also interacts with its own images
+                if (table)
+                    sum += 0.5 * mi * mi * table->potential(glm::vec3(0.0f), boxSize);
+                for (size_t j = i + 1; j < size(); j++)
+                {
+                    glm::vec3 d = particles.position(j) - particles.position(i);
+                    if (table)
+                        d = periodicDelta(d, boxSize);
+                    double phi = -1.0 / std::sqrt(glm::dot(d, d) + eps2);
+                    if (table)
+                        phi += table->potential(d, boxSize);
+                    sum += mi * particles.mass[j] * phi;
+                }
+            }
+            return sum;
+        }, [](double a, double b) { return a + b; }, 16);
+        return G * e;
+    }
+
+private:
+    bool forcesValid = false;
+    bool jerksValid = false;
+    size_t gasBodies = 0;
+
+    bool hydrodynamics() const
+    {
+        return gasBodies > 0 && !comoving;
+    }
+
+    // u += du/dt dt for the gas, kept non-negative
+    void kickEnergies(float dt)
+    {
+        ParticleStore& p = particles;
+        parallelFor(0, size(), [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+                p.energy[i] = std::max(p.energy[i] + p.energyRate[i] * dt, 0.0f);
+        }, 16384);
+    }
+
+    // state at the start of a Hermite step
+    struct HermiteState
+    {
+        glm::vec3 x, v, a, j;
+    };
+    std::vector<HermiteState> hermiteStart;
+
+    // accelerations and jerks by direct summation, whatever the solver setting
+    void computeHermiteForces()
+    {
+        directAccelerationsJerks(particles, softening);
+        ParticleStore& p = particles;
+        parallelFor(0, size(), [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+            {
+                p.ax[i] *= G; p.ay[i] *= G; p.az[i] *= G;
+                p.jx[i] *= G; p.jy[i] *= G; p.jz[i] *= G;
+            }
+        }, 16384);
+        forcesValid = jerksValid = true;
+    }
+
+    // Fourth order Hermite (Makino & Aarseth 1992): predict x and v from a
+    // and its derivative, evaluate a and jerk at the prediction, then correct
+    // with the two-point Hermite interpolant. The forces at the predicted
+    // state start the next step, so it is one evaluation per step like KDK.
+    // ------------------------------------------------------------------------
+    void hermiteStep()
+    {
+        if (!forcesValid || !jerksValid)
+            computeHermiteForces();
+
+        ParticleStore& p = particles;
+        const size_t n = size();
+        const float dt = timeStep;
+        const float dt2 = dt * dt;
+        hermiteStart.resize(n);
+
+        parallelFor(0, n, [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+            {
+                HermiteState& s = hermiteStart[i];
+                s.x = p.position(i);
+                s.v = p.velocity(i);
+                s.a = p.acceleration(i);
+                s.j = glm::vec3(p.jx[i], p.jy[i], p.jz[i]);
+                p.setPosition(i, s.x + s.v * dt + s.a * (dt2 / 2.0f) + s.j * (dt2 * dt / 6.0f));
+                p.setVelocity(i, s.v + s.a * dt + s.j * (dt2 / 2.0f));
+            }
+        }, 4096);
+
+        computeHermiteForces();
+
+        parallelFor(0, n, [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+            {
+                const HermiteState& s = hermiteStart[i];
+                glm::vec3 a1 = p.acceleration(i);
+                glm::vec3 j1(p.jx[i], p.jy[i], p.jz[i]);
+                glm::vec3 v1 = s.v + (s.a + a1) * (dt / 2.0f) + (s.j - j1) * (dt2 / 12.0f);
+                glm::vec3 x1 = s.x + (s.v + v1) * (dt / 2.0f) + (s.a - a1) * (dt2 / 12.0f);
+                p.setPosition(i, x1);
+                p.setVelocity(i, v1);
+            }
+        }, 4096);
+    }
+
+    // fold drifted bodies back into the periodic box
+    void wrapPositions()
+    {
+        if (boxSize <= 0.0f)
+            return;
+        ParticleStore& p = particles;
+        parallelFor(0, size(), [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+            {
+                p.x[i] = periodicWrap(p.x[i], boxSize);
+                p.y[i] = periodicWrap(p.y[i], boxSize);
+                p.z[i] = periodicWrap(p.z[i], boxSize);
+            }
+        }, 16384);
+    }
+
+    // block step scratch: tick on which each body's current step ends, the
+    // bodies whose step ends on each tick, the active list, the active
+    // bodies' accelerations before their update and their velocity change,
+    // and the time within the step each body's stored position belongs to
+    std::vector<uint32_t> endTick;
+    std::vector<std::vector<uint32_t>> due;
+    std::vector<uint32_t> active;
+    std::vector<glm::vec3> previousAcc, velocityChange;
+    std::vector<float> driftTime;
+
+    float levelStep(int level) const
+    {
+        return timeStep / (float)(1u << level);
+    }
+
+    // coarsest level whose step satisfies both criteria
+    int chooseLevel(size_t i) const
+    {
+        const ParticleStore& p = particles;
+        float a = glm::length(p.acceleration(i));
+        float dt = timeStep;
+        if (a > 0.0f)
+            dt = std::min(dt, std::sqrt(2.0f * timestepEta * softening / a));
+        if (p.jerk[i] > 0.0f)
+            dt = std::min(dt, jerkEta * a / p.jerk[i]);
+
+        int level = 0;
+        while (level < maxLevel && levelStep(level) > dt)
+            level++;
+        return level;
+    }
+
+    // One timeStep on the power-of-two block hierarchy, measured in ticks of
+    // timeStep / 2^maxLevel. Everyone is synchronised at both ends. In
+    // between, each body kicks at the ends of its own steps, and only the
+    // bodies whose step ends are drifted: the others keep the position of
+    // their last kick, which together with their unchanged velocity gives
+    // them anywhere in between. Bodies wait in per-tick lists, so empty ticks
+    // and bodies outside a substep cost nothing.
+    //
+    // Barnes-Hut with buckets (outside a periodic box) keeps the tree built
+    // at the start of the step and walks it predicted to each substep
+    // (Octree::beginPrediction), so a substep costs in proportion to its
+    // active bodies. The other solvers read every body, so everyone is
+    // drifted before they run.
+    // ------------------------------------------------------------------------
+    void blockStep()
+    {
+        ParticleStore& p = particles;
+        const size_t n = size();
+        const uint32_t ticks = 1u << maxLevel;
+        const float dtMin = timeStep / (float)ticks;
+        forceEvaluations = 0;
+        activeFraction = workFraction = evaluationsPerBody = 1.0;
+        if (n == 0)
+            return;
+        endTick.resize(n);
+        driftTime.assign(n, 0.0f);
+        due.resize(ticks + 1);
+        for (std::vector<uint32_t>& list : due)
+            list.clear();
+
+        // open everyone's first step with a half kick at the chosen level
+        parallelFor(0, n, [&](size_t b, size_t e)
+        {
+            for (size_t i = b; i < e; i++)
+            {
+                int level = chooseLevel(i);
+                p.level[i] = (uint8_t)level;
+                float half = 0.5f * levelStep(level);
+                p.vx[i] += p.ax[i] * half;
+                p.vy[i] += p.ay[i] * half;
+                p.vz[i] += p.az[i] * half;
+                endTick[i] = ticks >> level;
+            }
+        }, 16384);
+        for (size_t i = 0; i < n; i++)
+            due[endTick[i]].push_back((uint32_t)i);
+
+        const bool predicted = gravity && solver == ForceSolver::BarnesHut && tree.groupSize > 0 && boxSize <= 0.0f;
+        if (predicted)
+        {
+            tree.boxSize = boxSize;
+            tree.update(p);
+            tree.beginPrediction(p);
+        }
+
+        auto drift = [&](size_t b, size_t e, const uint32_t* bodies, float t)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                uint32_t i = bodies ? bodies[k] : (uint32_t)k;
+                float dt = t - driftTime[i];
+                p.x[i] += p.vx[i] * dt;
+                p.y[i] += p.vy[i] * dt;
+                p.z[i] += p.vz[i] * dt;
+                driftTime[i] = t;
+            }
+        };
+
+        uint32_t tick = 0;
+        size_t activeTotal = 0;
+        int finest = 0;
+        while (tick < ticks)
+        {
+            // every body's last step ends on the final tick, so this stops there
+            do
+                tick++;
+            while (due[tick].empty());
+            const float t = (float)tick * dtMin;
+            active.swap(due[tick]);
+            due[tick].clear();
+            std::sort(active.begin(), active.end());
+
+            previousAcc.resize(active.size());
+            velocityChange.resize(active.size());
+            for (size_t k = 0; k < active.size(); k++)
+                previousAcc[k] = p.acceleration(active[k]);
+
+            if (predicted)
+            {
+                parallelFor(0, active.size(), [&](size_t b, size_t e) { drift(b, e, active.data(), t); }, 4096);
+                tree.accelerationScale = G;
+                tree.predictedAccelerations(p, softening, active, t, driftTime);
+                for (uint32_t i : active)
+                    p.setAcceleration(i, G * p.acceleration(i));
+                jerksValid = false;
+            }
+            else
+            {
+                parallelFor(0, n, [&](size_t b, size_t e) { drift(b, e, nullptr, t); }, 16384);
+                wrapPositions();
+                computeForces(active);
+            }
+            activeTotal += active.size();
+            forceEvaluations++;
+
+            // close the finished steps, then open the next ones unless the block is over
+            parallelFor(0, active.size(), [&](size_t b, size_t e)
+            {
+                for (size_t k = b; k < e; k++)
+                {
+                    uint32_t i = active[k];
+                    int level = p.level[i];
+                    float half = 0.5f * levelStep(level);
+                    glm::vec3 acc = p.acceleration(i);
+                    p.vx[i] += acc.x * half;
+                    p.vy[i] += acc.y * half;
+                    p.vz[i] += acc.z * half;
+                    p.jerk[i] = glm::length(acc - previousAcc[k]) / levelStep(level);
+                    velocityChange[k] = acc * half;
+
+                    if (tick == ticks)
+                        continue;
+
+                    // a body may always refine, but only coarsen onto a tick its new level lands on
+                    int wanted = chooseLevel(i);
+                    while (wanted < level && tick % (ticks >> wanted) != 0)
+                        wanted++;
+                    p.level[i] = (uint8_t)wanted;
+                    half = 0.5f * levelStep(wanted);
+                    p.vx[i] += acc.x * half;
+                    p.vy[i] += acc.y * half;
+                    p.vz[i] += acc.z * half;
+                    velocityChange[k] += acc * half;
+                    endTick[i] = tick + (ticks >> wanted);
+                }
+            }, 1024);
+
+            for (size_t k = 0; k < active.size(); k++)
+            {
+                uint32_t i = active[k];
+                finest = std::max(finest, (int)p.level[i]);
+                if (tick == ticks)
+                    continue;
+                if (predicted)
+                    tree.kick(i, velocityChange[k], t, p.mass[i]);
+                due[endTick[i]].push_back(i);
+            }
+        }
+
+        activeFraction = (double)activeTotal / ((double)n * forceEvaluations);
+        workFraction = (double)activeTotal / ((double)n * (1u << finest));
+        evaluationsPerBody = (double)activeTotal / (double)n;
+    }
+    std::vector<uint64_t> reorderKeys;
+    std::vector<uint32_t> reorderOrder;
+
+    CosmologyTables cosmologyTables;
+};
+#endif
@@ -0,0 +1,86 @@
+#ifndef SIMULATION_CLOCK_H
+#define SIMULATION_CLOCK_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <algorithm>
+
+#include "ParticleStore.h"
+
+// Decouples physics from the render frame rate. Wall-clock frame time is
+// banked in an accumulator and paid out in fixed ticks; every tick runs
+// `substeps` simulation steps, so the physics per wall second is the same
+// at 30 or 300 FPS. The leftover fraction of a tick is what the renderer
+// interpolates by.
+class SimulationClock
+{
+public:
+    double tickSeconds;   // wall time covered by one physics tick
+    int substeps;         // simulation steps per tick
+    int maxTicksPerFrame; // catch-up cap; time beyond it is dropped instead of spiralling
+
+    double accumulator = 0.0;
+    unsigned long long droppedTicks = 0;
+
+    SimulationClock(double tickSeconds = 1.0 / 60.0, int substeps = 1, int maxTicksPerFrame = 4)
+        : tickSeconds(tickSeconds), substeps(substeps), maxTicksPerFrame(maxTicksPerFrame)
+    {
+    }
+
+    // bank a frame's wall time and return how many ticks to run now
+    // ------------------------------------------------------------------------
+    int advance(double frameSeconds)
+    {
+        accumulator += std::max(frameSeconds, 0.0);
+        int ticks = (int)(accumulator / tickSeconds);
+        if (ticks > maxTicksPerFrame)
+        {
+            // a slow frame (or a stall in the debugger): run the cap and forget the rest,
+            // keeping the fraction so interpolation stays continuous
+            droppedTicks += ticks - maxTicksPerFrame;
+            accumulator -= (double)(ticks - maxTicksPerFrame) * tickSeconds;
+            ticks = maxTicksPerFrame;
+        }
+        accumulator -= ticks * tickSeconds;
+        return ticks;
+    }
+
+    // how far the render time sits between the previous and the current physics state
+    float alpha() const
+    {
+        return (float)std::min(accumulator / tickSeconds, 1.0);
+    }
+};
+
+// Positions at the start of the latest tick, so frames can be drawn between
+// the last two physics states rather than snapping to the newest one. Stored
+// by particle id, since the simulation may reorder its arrays in between.
+class PositionHistory
+{
+public:
+    AlignedVector<float> x, y, z;
+
+    void capture(const ParticleStore& p)
+    {
+        x.resize(p.size());
+        y.resize(p.size());
+        z.resize(p.size());
+        for (size_t i = 0; i < p.size(); i++)
+        {
+            uint32_t id = p.id[i];
+            x[id] = p.x[i];
+            y[id] = p.y[i];
+            z[id] = p.z[i];
+        }
+    }
+
+    glm::vec3 interpolate(const ParticleStore& p, size_t i, float alpha) const
+    {
+        uint32_t id = p.id[i];
+        if (id >= x.size())
+            return p.position(i);
+        return glm::mix(glm::vec3(x[id], y[id], z[id]), p.position(i), alpha);
+    }
+};
+#endif
@@ -0,0 +1,163 @@
+#ifndef SIMULATION_THREAD_H
+#define SIMULATION_THREAD_H
+
+#include <glm/glm.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "Simulation.h"
+#include "SimulationClock.h"
+#include "TripleBuffer.h"
+
+// One published physics state: positions at the end of the latest tick and
+// at its start, so the renderer can still interpolate between them. Both are
+// indexed by particle id, so the order is stable across Morton reorders.
+struct PhysicsFrame
+{
+    AlignedVector<float> x, y, z;
+    PositionHistory previous;
+    double time = 0.0;                // simulation time
+    bool comoving = false;
+    double scaleFactor = 1.0;         // a of a comoving run
+    unsigned long long stepCount = 0;
+    double wallTime = 0.0;            // wall clock time at which this state became due
+
+    glm::vec3 interpolate(size_t id, float alpha) const
+    {
+        glm::vec3 current(x[id], y[id], z[id]);
+        if (id >= previous.x.size())
+            return current;
+        return glm::mix(glm::vec3(previous.x[id], previous.y[id], previous.z[id]), current, alpha);
+    }
+};
+
+// Runs the integrator on its own thread, paced by a SimulationClock, and
+// hands finished states to the render thread through a TripleBuffer. Once
+// started the Simulation belongs to this thread; the renderer only reads
+// frames from latest().
+class SimulationThread
+{
+public:
+    SimulationThread(Simulation& sim, const SimulationClock& clock)
+        : sim(sim), clock(clock), epoch(std::chrono::steady_clock::now())
+    {
+        // every slot starts as the initial state, so the reader is valid before the first publish
+        for (int i = 0; i < 3; i++)
+            writeFrame(frames.slot(i), true, 0.0);
+    }
+
+    ~SimulationThread()
+    {
+        stop();
+    }
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    void start()
+    {
+        if (worker.joinable())
+            return;
+        running = true;
+        worker = std::thread(&SimulationThread::run, this);
+    }
+
+    void stop()
+    {
+        running = false;
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // render thread side: never blocks, returns the newest complete state
+    // ------------------------------------------------------------------------
+    const PhysicsFrame& latest()
+    {
+        frames.update();
+        return frames.readBuffer();
+    }
+
+    // position of "now" between the frame's previous and current state
+    float alpha(const PhysicsFrame& frame) const
+    {
+        double a = (wallSeconds() - frame.wallTime) / clock.tickSeconds;
+        return (float)std::min(std::max(a, 0.0), 1.0);
+    }
+
+    unsigned long long droppedTicks() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    Simulation& sim;
+    SimulationClock clock;
+    TripleBuffer<PhysicsFrame> frames;
+    std::chrono::steady_clock::time_point epoch;
+    std::thread worker;
+    std::atomic<bool> running{ false };
+    std::atomic<unsigned long long> dropped{ 0 };
+
+    double wallSeconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    void writeFrame(PhysicsFrame& frame, bool capturePrevious, double dueTime)
+    {
+        const ParticleStore& p = sim.particles;
+        if (capturePrevious)
+            frame.previous.capture(p);
+        frame.x.resize(p.size());
+        frame.y.resize(p.size());
+        frame.z.resize(p.size());
+        for (size_t i = 0; i < p.size(); i++)
+        {
+            uint32_t id = p.id[i];
+            frame.x[id] = p.x[i];
+            frame.y[id] = p.y[i];
+            frame.z[id] = p.z[i];
+        }
+        frame.time = sim.time;
+        frame.comoving = sim.comoving;
+        frame.scaleFactor = sim.scaleFactor;
+        frame.stepCount = sim.stepCount;
+        frame.wallTime = dueTime;
+    }
+
+    // ------------------------------------------------------------------------
+    void run()
+    {
+        double last = wallSeconds();
+        while (running)
+        {
+            double now = wallSeconds();
+            int ticks = clock.advance(now - last);
+            last = now;
+            dropped.store(clock.droppedTicks, std::memory_order_relaxed);
+
+            if (ticks == 0)
+            {
+                // ahead of schedule, sleep until the next tick is due
+                std::this_thread::sleep_for(std::chrono::duration<double>(clock.tickSeconds - clock.accumulator));
+                continue;
+            }
+
+            PhysicsFrame& frame = frames.writeBuffer();
+            for (int t = 0; t < ticks; t++)
+            {
+                if (t == ticks - 1)
+                    frame.previous.capture(sim.particles);
+                for (int s = 0; s < clock.substeps; s++)
+                    sim.step();
+            }
+            // the new state belongs to the tick boundary `accumulator` seconds before now
+            writeFrame(frame, false, now - clock.accumulator);
+            frames.publish();
+        }
+    }
+};
+#endif
@@ -3,8 +3,10 @@
 #define SPHERE_H
 
 #include <iostream>
+#include <vector>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
 #include <math.h>
 
 class Sphere {
@@ -13,7 +15,9 @@ public:
     static const int num_stacks = 30;  // vertical slices
     std::vector<float> vertices;
     std::vector<GLuint> indices;
-    GLuint vbo, ebo; // Vertex Buffer Object and Element Buffer Object
+    GLuint vao, vbo, ebo; // Vertex Array Object, Vertex Buffer Object and Element Buffer Object
+    GLuint instanceVbo;   // per-instance data: all transforms first, then all colours
+    GLsizei instanceCapacity = 0;
     float r;
 
     Sphere(float radius) {
@@ -24,19 +28,53 @@ public:
     }
 
     ~Sphere() {
+        glDeleteVertexArrays(1, &vao);
         glDeleteBuffers(1, &vbo);
         glDeleteBuffers(1, &ebo);
+        glDeleteBuffers(1, &instanceVbo);
     }
 
     void draw() {
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glDisableVertexAttribArray(0);
+        glBindVertexArray(vao);
+        glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+    }
+
+    // Instanced drawing: attribute 1 = vec4(centre.xyz, scale), attribute 2 = vec4 colour.
+    // Growing the buffer discards its contents, so re-upload colours after a reserve that grows.
+    void reserveInstances(GLsizei count) {
+        if (count <= instanceCapacity)
+            return;
+        instanceCapacity = count;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        glBufferData(GL_ARRAY_BUFFER, 2 * count * sizeof(glm::vec4), NULL, GL_DYNAMIC_DRAW);
+
+        // colours start after the transform block, so their offset follows the capacity
+        glBindVertexArray(vao);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)(count * sizeof(glm::vec4)));
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void updateInstanceTransforms(const glm::vec4* transforms, GLsizei count) {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec4), transforms);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    void updateInstanceColors(const glm::vec4* colors, GLsizei count) {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+        glBufferSubData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(glm::vec4), count * sizeof(glm::vec4), colors);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // one draw call for every star
+    void drawInstanced(GLsizei count) {
+        glBindVertexArray(vao);
+        glDrawElementsInstanced(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0, count);
+        glBindVertexArray(0);
     }
 
     float getRadius() const {
@@ -93,15 +131,29 @@ private:
         }
     }
 
+    // vertex layout is recorded in the VAO once, draw calls only bind it
     void createBuffers() {
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+
         glGenBuffers(1, &vbo);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
         glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(0);
 
         glGenBuffers(1, &ebo);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
 
+        // instance attributes advance once per star; pointers are set in reserveInstances()
+        glGenBuffers(1, &instanceVbo);
+        glEnableVertexAttribArray(1);
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribDivisor(2, 1);
+
+        glBindVertexArray(0);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
@@ -0,0 +1,331 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Work-stealing task pool. Every worker owns a deque: it pushes and pops its
+// own tasks at the back (newest first, still warm in cache) and, when it runs
+// dry, steals the oldest task from the front of another worker's deque. The
+// thread that waits on a TaskGroup runs tasks too, so a pool of N threads
+// has N - 1 workers and a pool of 1 simply runs everything inline.
+class ThreadPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    explicit ThreadPool(unsigned int threads = defaultThreadCount(), bool pinThreads = false)
+        : threadCount(std::max(1u, threads)), queues(threadCount)
+    {
+        for (unsigned int w = 1; w < threadCount; w++)
+        {
+            workers.emplace_back(&ThreadPool::workerLoop, this, w);
+            if (pinThreads)
+                pinToCore(workers.back(), w);
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    static unsigned int defaultThreadCount()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // threads taking part in parallel work, including the caller
+    unsigned int size() const
+    {
+        return threadCount;
+    }
+
+    // queue a task on the calling worker's deque, or spread external
+    // submissions over the deques round robin
+    // ------------------------------------------------------------------------
+    void submit(Task task)
+    {
+        unsigned int q = currentWorker();
+        if (q == NOT_A_WORKER)
+            q = nextQueue.fetch_add(1, std::memory_order_relaxed) % threadCount;
+        {
+            std::lock_guard<std::mutex> lock(queues[q].mutex);
+            queues[q].tasks.push_back(std::move(task));
+        }
+        pending.fetch_add(1, std::memory_order_release);
+        {
+            // pairs with the predicate check in workerLoop so a wakeup can't be lost
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    // run one queued task on the calling thread; false if there was none
+    bool runOne()
+    {
+        unsigned int self = currentWorker();
+        Task task;
+        if (!takeTask(self == NOT_A_WORKER ? 0 : self, task))
+            return false;
+        task();
+        return true;
+    }
+
+private:
+    static const unsigned int NOT_A_WORKER = ~0u;
+
+    // padded so neighbouring deques don't share a cache line
+    struct alignas(64) WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    unsigned int threadCount;
+    std::vector<WorkQueue> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> pending{ 0 };
+    std::atomic<unsigned int> nextQueue{ 0 };
+    bool stopping = false;
+
+    // which of this pool's workers the calling thread is
+    static const ThreadPool*& workerPool()
+    {
+        static thread_local const ThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static unsigned int& workerIndex()
+    {
+        static thread_local unsigned int index = NOT_A_WORKER;
+        return index;
+    }
+
+    unsigned int currentWorker() const
+    {
+        return workerPool() == this ? workerIndex() : NOT_A_WORKER;
+    }
+
+    // own deque from the back, then steal from the front of the others
+    // ------------------------------------------------------------------------
+    bool takeTask(unsigned int self, Task& task)
+    {
+        if (pending.load(std::memory_order_acquire) == 0)
+            return false;
+        for (unsigned int k = 0; k < threadCount; k++)
+        {
+            unsigned int q = (self + k) % threadCount;
+            std::lock_guard<std::mutex> lock(queues[q].mutex);
+            std::deque<Task>& tasks = queues[q].tasks;
+            if (tasks.empty())
+                continue;
+            if (k == 0)
+            {
+                task = std::move(tasks.back());
+                tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(unsigned int self)
+    {
+        workerPool() = this;
+        workerIndex() = self;
+        for (;;)
+        {
+            Task task;
+            if (takeTask(self, task))
+            {
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this] { return stopping || pending.load(std::memory_order_acquire) > 0; });
+            if (stopping && pending.load(std::memory_order_acquire) == 0)
+                return;
+        }
+    }
+
+    static void pinToCore(std::thread& thread, unsigned int core)
+    {
+        unsigned int cores = defaultThreadCount();
+        core %= cores;
+#if defined(_WIN32)
+        if (core < 8 * sizeof(DWORD_PTR))
+            SetThreadAffinityMask((HANDLE)thread.native_handle(), (DWORD_PTR)1 << core);
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(core, &set);
+        pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#else
+        (void)thread;
+#endif
+    }
+};
+
+// A batch of tasks that can be waited on. wait() keeps the waiting thread
+// busy with queued work (its own group's or anyone's), so groups can nest
+// inside tasks without tying up workers.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool& pool)
+        : pool(pool)
+    {
+    }
+
+    ~TaskGroup()
+    {
+        wait();
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <typename F>
+    void run(F&& f)
+    {
+        outstanding.fetch_add(1, std::memory_order_relaxed);
+        pool.submit([this, f = std::forward<F>(f)]() mutable
+        {
+            f();
+            outstanding.fetch_sub(1, std::memory_order_release);
+        });
+    }
+
+    void wait()
+    {
+        while (outstanding.load(std::memory_order_acquire) > 0)
+        {
+            if (!pool.runOne())
+                std::this_thread::yield();
+        }
+    }
+
+private:
+    ThreadPool& pool;
+    std::atomic<size_t> outstanding{ 0 };
+};
+
+// the pool shared by the solvers; reconfigure only while nothing is running on it
+// ------------------------------------------------------------------------
+inline std::unique_ptr<ThreadPool>& globalThreadPoolStorage()
+{
+    static std::unique_ptr<ThreadPool> pool;
+    return pool;
+}
+
+inline ThreadPool& threadPool()
+{
+    std::unique_ptr<ThreadPool>& pool = globalThreadPoolStorage();
+    if (!pool)
+        pool.reset(new ThreadPool());
+    return *pool;
+}
+
+inline void configureThreadPool(unsigned int threads, bool pinThreads = false)
+{
+    std::unique_ptr<ThreadPool>& pool = globalThreadPoolStorage();
+    pool.reset();
+    pool.reset(new ThreadPool(threads == 0 ? ThreadPool::defaultThreadCount() : threads, pinThreads));
+}
+
+// Calls body(begin, end) on disjoint chunks covering [begin, end). Chunks are
+// at least `grain` items and there are a few per thread, so stealing can even
+// out uneven work such as tree walks.
+// ------------------------------------------------------------------------
+template <typename Body>
+void parallelFor(size_t begin, size_t end, Body body, size_t grain = 256)
+{
+    if (end <= begin)
+        return;
+    ThreadPool& pool = threadPool();
+    const size_t n = end - begin;
+    size_t chunks = std::min<size_t>(8 * pool.size(), (n + grain - 1) / std::max<size_t>(grain, 1));
+    if (pool.size() == 1 || chunks <= 1)
+    {
+        body(begin, end);
+        return;
+    }
+
+    const size_t chunkSize = (n + chunks - 1) / chunks;
+    TaskGroup group(pool);
+    for (size_t b = begin + chunkSize; b < end; b += chunkSize)
+    {
+        size_t e = std::min(end, b + chunkSize);
+        group.run([&body, b, e] { body(b, e); });
+    }
+    body(begin, std::min(end, begin + chunkSize));
+    group.wait();
+}
+
+// parallelFor with one partial result per chunk, combined in chunk order so
+// the result doesn't depend on which thread ran what
+// ------------------------------------------------------------------------
+template <typename T, typename Map, typename Combine>
+T parallelReduce(size_t begin, size_t end, T identity, Map map, Combine combine, size_t grain = 256)
+{
+    if (end <= begin)
+        return identity;
+    const size_t chunks = std::max<size_t>(1, std::min<size_t>(8 * threadPool().size(), (end - begin + grain - 1) / std::max<size_t>(grain, 1)));
+    const size_t chunkSize = (end - begin + chunks - 1) / chunks;
+    std::vector<T> partial(chunks, identity);
+    parallelFor(0, chunks, [&](size_t c0, size_t c1)
+    {
+        for (size_t c = c0; c < c1; c++)
+        {
+            size_t b = begin + c * chunkSize;
+            if (b < end)
+                partial[c] = map(b, std::min(end, b + chunkSize));
+        }
+    }, 1);
+
+    T result = identity;
+    for (const T& value : partial)
+        result = combine(result, value);
+    return result;
+}
+#endif
@@ -0,0 +1,111 @@
+#ifndef TREE_PM_H
+#define TREE_PM_H
+
+#include <vector>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "ParticleStore.h"
+#include "Octree.h"
+#include "ParticleMesh.h"
+#include "ThreadPool.h"
+
+// TreePM (Bagla 2002, GADGET-2): the 1/r potential is split at a scale rs
+// into a long-range part -erf(r / 2rs) / r, solved on the mesh, and a
+// short-range part -erfc(r / 2rs) / r, summed by a tree walk that ignores
+// everything beyond cutoff * rs (erfc(2.25) ~ 1.5e-3 at the default 4.5).
+// The mesh supplies what a plain tree spends most of its time on (far
+// cells), the tree supplies the resolution the mesh lacks.
+//
+// splitCells sets rs in mesh cells and is the accuracy/speed knob: a larger
+// split moves more of the force into the tree (slower, more accurate) and
+// leaves the mesh only the smooth long-range part; below about one cell
+// the mesh's own smoothing starts to show up as force error.
+class TreePM
+{
+public:
+    Octree tree;
+    ParticleMesh mesh;
+    float splitCells = 1.25f;
+
+    // seconds spent in each half during the last evaluation
+    double meshSeconds = 0.0, treeSeconds = 0.0;
+
+    TreePM()
+    {
+        mesh.gridSize = 64;
+    }
+
+    // accelerations (without G) for every particle into ax/ay/az
+    // ------------------------------------------------------------------------
+    void accelerations(ParticleStore& p, float softening)
+    {
+        longRange(p, softening, nullptr, p.size());
+        auto start = std::chrono::steady_clock::now();
+        tree.accelerations(p, softening);
+        addLongRange(p, nullptr, p.size());
+        treeSeconds = seconds(start);
+    }
+
+    void accelerations(ParticleStore& p, float softening, const std::vector<uint32_t>& targets)
+    {
+        longRange(p, softening, &targets, targets.size());
+        auto start = std::chrono::steady_clock::now();
+        tree.accelerations(p, softening, targets);
+        addLongRange(p, targets.data(), targets.size());
+        treeSeconds = seconds(start);
+    }
+
+private:
+    // mesh accelerations, parked while the tree overwrites ax/ay/az
+    std::vector<float> longX, longY, longZ;
+
+    static double seconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void longRange(ParticleStore& p, float softening, const std::vector<uint32_t>* targets, size_t count)
+    {
+        auto start = std::chrono::steady_clock::now();
+        mesh.splitCells = splitCells;
+        if (targets)
+            mesh.accelerations(p, softening, *targets);
+        else
+            mesh.accelerations(p, softening);
+
+        // the split radius follows the mesh's cell size, which follows the particles
+        tree.splitRadius = mesh.splitRadius();
+
+        longX.resize(count);
+        longY.resize(count);
+        longZ.resize(count);
+        parallelFor(0, count, [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                size_t i = targets ? (*targets)[k] : k;
+                longX[k] = p.ax[i];
+                longY[k] = p.ay[i];
+                longZ[k] = p.az[i];
+            }
+        }, 16384);
+        meshSeconds = seconds(start);
+    }
+
+    void addLongRange(ParticleStore& p, const uint32_t* targets, size_t count)
+    {
+        parallelFor(0, count, [&](size_t b, size_t e)
+        {
+            for (size_t k = b; k < e; k++)
+            {
+                size_t i = targets ? targets[k] : k;
+                p.ax[i] += longX[k];
+                p.ay[i] += longY[k];
+                p.az[i] += longZ[k];
+            }
+        }, 16384);
+    }
+};
+#endif
@@ -0,0 +1,60 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer triple buffer. The writer
+// fills its back slot and publishes it by swapping it with the middle slot;
+// the reader swaps the middle slot into its front slot whenever a newer one
+// is waiting. Neither side ever waits for the other, and the reader always
+// sees the most recent complete state (intermediate ones are skipped).
+template <typename T>
+class TripleBuffer
+{
+public:
+    // writer side
+    // ------------------------------------------------------------------------
+    T& writeBuffer()
+    {
+        return slots[back];
+    }
+
+    void publish()
+    {
+        uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = previous & INDEX_MASK;
+    }
+
+    // reader side; returns true if a newer state was swapped in
+    // ------------------------------------------------------------------------
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+        front = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T& readBuffer() const
+    {
+        return slots[front];
+    }
+
+    // only safe before the writer thread starts
+    T& slot(int i)
+    {
+        return slots[i];
+    }
+
+private:
+    static const uint8_t INDEX_MASK = 0x3;
+    static const uint8_t FRESH = 0x4;
+
+    T slots[3];
+    uint8_t back = 0;             // owned by the writer
+    std::atomic<uint8_t> middle{ 1 };
+    uint8_t front = 2;            // owned by the reader
+};
+#endif
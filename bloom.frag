@@ -11,8 +11,6 @@ uniform vec2  centerScreen;   // center of sphere in pixels
 uniform float sphereRadiusPx; // radius of the solid sphere on screen (pixels)
 uniform float glowWidthPx;    // thickness of glow band (pixels)
 
-uniform float time;
-
 void main()
 {
     // fragment position in screen space
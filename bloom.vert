@@ -2,8 +2,16 @@
 layout(location = 0) in vec3 aPos;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// per-frame data, must match FrameData in FrameUniforms.h
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewport; // xy = size in pixels, zw = 1 / size
+    float time;
+};
 
 out vec3 worldPos;
 
@@ -11,5 +19,5 @@ void main()
 {
     vec4 wp = model * vec4(aPos, 1.0);
     worldPos = wp.xyz;
-    gl_Position = projection * view * wp;
+    gl_Position = viewProjection * wp;
 }
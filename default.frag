@@ -2,9 +2,7 @@
 out vec4 FragColor;
 in vec3 ourColor;
 
-uniform vec3 color;
-
 void main()
 {
-	gl_FragColor = vec4(color, 1.0f);
+	FragColor = vec4(ourColor, 1.0f);
 }
\ No newline at end of file
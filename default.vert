@@ -1,17 +1,23 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 2) in vec3 aColor;
+layout (location = 1) in vec4 aInstance; // xyz = star centre, w = scale
+layout (location = 2) in vec4 aColor;
 
 out vec3 ourColor;
 
-uniform mat4 transform;
-
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-frame data, must match FrameData in FrameUniforms.h
+layout (std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	mat4 viewProjection;
+	vec4 viewport; // xy = size in pixels, zw = 1 / size
+	float time;
+};
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0f);
-	ourColor = aPos;
+	vec3 worldPos = aInstance.xyz + aPos * aInstance.w;
+	gl_Position = viewProjection * vec4(worldPos, 1.0f);
+	ourColor = aColor.rgb;
 }
\ No newline at end of file
@@ -0,0 +1,47 @@
+#version 330 core
+out vec4 FragColor;
+
+// simple, angle-independent glow around the projected circle, one quad per star
+
+uniform vec3  color;          // glow colour, e.g. vec3(1.0)
+uniform float glowStrength;   // base intensity, pulses by +-0.25 over time
+
+// per-frame data, must match FrameData in FrameUniforms.h
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewport; // xy = size in pixels, zw = 1 / size
+    float time;
+};
+
+// per star, from glow.vert
+flat in vec2  centerScreen;   // center of sphere in pixels
+flat in float sphereRadiusPx; // radius of the solid sphere on screen (pixels)
+flat in float glowWidthPx;    // thickness of glow band (pixels)
+
+void main()
+{
+    // fragment position in screen space
+    vec2 frag = gl_FragCoord.xy;
+
+    // distance from sphere centre
+    float dist = length(frag - centerScreen);
+
+    float inner = sphereRadiusPx;                 // where the solid sphere ends
+    float outer = sphereRadiusPx + glowWidthPx;   // where glow ends
+
+    // how far outside the sphere edge we are: 0 at edge, 1 at outer border
+    float d = (dist - inner) / (outer - inner);
+    d = clamp(d, 0.0, 9000.0);
+
+    // smooth falloff (0 at outer edge, 1 at sphere edge)
+    float falloff = exp(-0.05 * d * d);
+
+    float strength = glowStrength + 0.25 * sin(time * 3.5);
+    vec3 glow = color * strength * falloff;
+
+    // alpha = falloff so blending can fade it out
+    FragColor = vec4(glow, falloff);
+}
@@ -0,0 +1,55 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;   // quad corner, -1..1
+layout (location = 1) in vec4 aInstance; // per star: xyz = world centre, w = sphere radius
+
+// per-frame data, must match FrameData in FrameUniforms.h
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    vec4 viewport; // xy = size in pixels, zw = 1 / size
+    float time;
+};
+
+flat out vec2  centerScreen;
+flat out float sphereRadiusPx;
+flat out float glowWidthPx;
+
+// glow band thickness as a fraction of the sphere's pixel radius
+const float GLOW_WIDTH = 0.4;
+// glow.frag's falloff adds less than half an 8-bit step beyond this many glow widths
+const float GLOW_REACH = 8.5;
+
+vec2 toPixels(vec4 clip)
+{
+    return (clip.xy / clip.w * 0.5 + 0.5) * viewport.xy;
+}
+
+void main()
+{
+    vec4 viewCenter = view * vec4(aInstance.xyz, 1.0);
+    vec4 clipCenter = projection * viewCenter;
+
+    // visibility gate: centre in front of the camera and inside the frustum,
+    // otherwise collapse the quad to a point outside the clip volume
+    bool visible = viewCenter.z < 0.0 && clipCenter.w > 0.0 &&
+        all(lessThanEqual(abs(clipCenter.xyz), vec3(clipCenter.w)));
+    if (!visible)
+    {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        return;
+    }
+
+    // pixel radius from a point one radius along the camera's right axis,
+    // which is +x in view space
+    centerScreen = toPixels(clipCenter);
+    vec2 edgeScreen = toPixels(projection * (viewCenter + vec4(aInstance.w, 0.0, 0.0, 0.0)));
+    sphereRadiusPx = length(edgeScreen - centerScreen);
+    glowWidthPx = sphereRadiusPx * GLOW_WIDTH;
+
+    // bounded quad around the star instead of the whole screen
+    float extentPx = sphereRadiusPx + glowWidthPx * GLOW_REACH;
+    vec2 pixel = centerScreen + aCorner * extentPx;
+    gl_Position = vec4(pixel * viewport.zw * 2.0 - 1.0, 0.0, 1.0);
+}